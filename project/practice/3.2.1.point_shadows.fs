@@ -5,19 +5,18 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    flat vec4 Flags;    // per-draw flags (x: reverse normals, y: light, z: another)
+    flat vec3 ViewPos;  // eye of the view, which differs per layer in layered rendering
 } fs_in;
 
 uniform sampler2D diffuseTexture;
 uniform samplerCube depthMap;
 
 uniform vec3 lightPos;
-uniform vec3 viewPos;
 
 uniform float far_plane;
 
 uniform bool shadows;
-uniform bool light;
-uniform bool another;
 
 
 
@@ -66,7 +65,7 @@ float ShadowCalculationpcss(vec3 fragPos)
     float shadow = 0.0;
     float bias = 0.15;
     int samples = 20;
-    float viewDistance = length(viewPos - fragPos);
+    float viewDistance = length(fs_in.ViewPos - fragPos);
     float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;   //  κ pcss penumbra
     for(int i = 0; i < samples; ++i)
     {
@@ -106,6 +105,8 @@ float ShadowCalculation(vec3 fragPos)
 
 void main()
 {           
+    bool light = fs_in.Flags.y > 0.5;
+    bool another = fs_in.Flags.z > 0.5;
     if (light) FragColor = vec4(1.0);
     else {
 
@@ -122,7 +123,7 @@ void main()
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * lightColor;
     // specular
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+    vec3 viewDir = normalize(fs_in.ViewPos - fs_in.FragPos);
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = 0.0;
     vec3 halfwayDir = normalize(lightDir + viewDir);  
@@ -2,29 +2,39 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in uint aDrawID;
 
 out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    flat vec4 Flags;
+    flat vec3 ViewPos;
 } vs_out;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
+uniform vec3 viewPos;
 
-uniform bool reverse_normals;
+// per-draw data, DRAW_DATA_TEXELS texels per draw: model matrix columns, then flags
+// (x: reverse normals, y: light, z: another, w: shadow faces, unused here)
+uniform samplerBuffer drawData;
 
 void main()
 {
+    int base = int(aDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    vs_out.Flags = texelFetch(drawData, base + 4);
+
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
 
-    if(reverse_normals) // a slight hack to make sure the outer large cube displays lighting from the 'inside' instead of the default 'outside'.
+    if(vs_out.Flags.x > 0.5) // a slight hack to make sure the outer large cube displays lighting from the 'inside' instead of the default 'outside'.
         vs_out.Normal = transpose(inverse(mat3(model))) * (-1.0 * aNormal);
     else
         vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
 
     vs_out.TexCoords = aTexCoords;
+    vs_out.ViewPos = viewPos;
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
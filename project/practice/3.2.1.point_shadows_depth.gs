@@ -4,12 +4,16 @@ layout (triangle_strip, max_vertices=18) out;
 
 uniform mat4 shadowMatrices[6];
 
+flat in int vFaceMask[]; // faces the object's bounds touch (bit i for layer i)
+
 out vec4 FragPos; // FragPos from GS (output per emitvertex)
 
 void main()
 {
     for(int face = 0; face < 6; ++face)
     {
+        if((vFaceMask[0] & (1 << face)) == 0)
+            continue;
         gl_Layer = face; // built-in variable that specifies to which face we render.
         for(int i = 0; i < 3; ++i) // for each triangle's vertices
         {
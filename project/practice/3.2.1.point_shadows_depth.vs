@@ -1,9 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawID;
 
-uniform mat4 model;
+// per-draw data, the model matrix is in the first 4 texels of each draw, the cube map faces the
+// draw touches in the w of the fifth
+uniform samplerBuffer drawData;
+
+flat out int vFaceMask;
 
 void main()
 {
+    int base = int(aDrawID) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    vFaceMask = int(texelFetch(drawData, base + 4).w);
     gl_Position = model * vec4(aPos, 1.0);
 }
\ No newline at end of file
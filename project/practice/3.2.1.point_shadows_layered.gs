@@ -0,0 +1,44 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices=3) out;
+
+#define MAX_VIEWS 16 // LAYERED_MAX_VIEWS
+
+layout (std140) uniform Views {
+    mat4 viewProjection[MAX_VIEWS];
+    vec4 viewPosition[MAX_VIEWS];
+};
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+    flat vec4 Flags;
+} gs_in[];
+
+flat in int vView[];
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+    flat vec4 Flags;
+    flat vec3 ViewPos;
+} gs_out;
+
+void main()
+{
+    int view = vView[0];
+    gl_Layer = view; // each view renders into its own layer of the texture array
+    for(int i = 0; i < 3; ++i)
+    {
+        gs_out.FragPos = gs_in[i].FragPos;
+        gs_out.Normal = gs_in[i].Normal;
+        gs_out.TexCoords = gs_in[i].TexCoords;
+        gs_out.Flags = gs_in[i].Flags;
+        gs_out.ViewPos = viewPosition[view].xyz;
+        gl_Position = viewProjection[view] * gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
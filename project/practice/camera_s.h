@@ -66,6 +66,20 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // turns the camera towards target, for viewpoints that don't come from the mouse (camera_sampler.h)
+    void LookAt(const glm::vec3& target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Pitch = glm::degrees(asin(glm::clamp(direction.y, -1.0f, 1.0f)));
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        // same limit as the mouse, or Right degenerates
+        if (Pitch > 89.0f)
+            Pitch = 89.0f;
+        if (Pitch < -89.0f)
+            Pitch = -89.0f;
+        updateCameraVectors();
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -0,0 +1,158 @@
+#ifndef CAMERA_SAMPLER_H
+#define CAMERA_SAMPLER_H
+
+#include <glm/glm.hpp>
+
+#include "camera_s.h"
+#include "draw_list.h"
+#include "scene_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Programmatic viewpoints for dataset capture, so one light's depth cube map can be rendered from
+// many cameras. The objects to look at and to keep out of are the draw list's bounding spheres,
+// minus the room (DRAW_REVERSE_NORMALS) and the light marker (DRAW_LIGHT), which works for the
+// hand-written scenes and the generated ones alike. Viewpoints are seeded like scenes: the same
+// (seed, key) gives the same sequence of views.
+
+enum CameraSampleMode {
+    CAMERA_SAMPLE_ORBIT,            // around the middle of the objects, spread evenly over the views
+    CAMERA_SAMPLE_IN_ROOM,          // anywhere free in the room, looking at a random point
+    CAMERA_SAMPLE_LOOK_AT_OBJECT,   // near a random object, looking at it
+    CAMERA_SAMPLE_MIXED             // one of the above per view
+};
+
+struct CameraSamplerSettings {
+    float clearance = 0.3f;         // free space between the eye and any object or wall
+    float orbitMin = 4.0f;          // orbit distance from the target
+    float orbitMax = 9.0f;
+    float orbitPitch = 35.0f;       // orbit elevation is within +-this many degrees
+    float objectDistanceMin = 1.5f; // look-at distance in bounding sphere radii
+    float objectDistanceMax = 4.0f;
+    unsigned int attempts = 32;     // position tries per view before the best so far is taken
+};
+
+class CameraSampler
+{
+public:
+    CameraSamplerSettings settings;
+
+    CameraSampler() : random(0) {}
+
+    // starts the view sequence of one capture (a scene and light); key tells captures apart
+    void Begin(uint64_t seed, uint64_t key)
+    {
+        random = SceneRandom(seed ^ 0x63616d657261ull, key);
+    }
+
+    // places camera for view of views in the capture
+    void Next(Camera& camera, CameraSampleMode mode, const SceneDrawList& scene, unsigned int view, unsigned int views)
+    {
+        if (mode == CAMERA_SAMPLE_MIXED)
+            mode = (CameraSampleMode)random.Below(CAMERA_SAMPLE_MIXED);
+        unsigned int objects = countObjects(scene);
+        if (mode == CAMERA_SAMPLE_LOOK_AT_OBJECT && objects == 0)
+            mode = CAMERA_SAMPLE_IN_ROOM;
+
+        glm::vec3 target(0.0f);
+        if (mode == CAMERA_SAMPLE_ORBIT)
+        {
+            // middle of the objects, so the orbit keeps them in view
+            float weight = 0.0f;
+            for (size_t i = 0; i < scene.Size(); ++i)
+                if (isObject(scene, i))
+                {
+                    target += glm::vec3(scene.bounds[i]) * scene.bounds[i].w;
+                    weight += scene.bounds[i].w;
+                }
+            if (weight > 0.0f)
+                target = target * (1.0f / weight);
+            float azimuth = (view + random.Uniform()) / std::max(views, 1u) * 6.2831853f;
+            glm::vec3 eye = place(scene, [&]() {
+                float pitch = glm::radians(random.Uniform(-settings.orbitPitch, settings.orbitPitch));
+                float distance = random.Uniform(settings.orbitMin, settings.orbitMax);
+                return target + distance * glm::vec3(std::cos(pitch) * std::cos(azimuth), std::sin(pitch), std::cos(pitch) * std::sin(azimuth));
+            });
+            camera.Position = eye;
+        }
+        else if (mode == CAMERA_SAMPLE_LOOK_AT_OBJECT)
+        {
+            glm::vec4 object = nthObject(scene, random.Below(objects));
+            target = glm::vec3(object);
+            camera.Position = place(scene, [&]() {
+                float distance = object.w * random.Uniform(settings.objectDistanceMin, settings.objectDistanceMax);
+                return target + random.UnitVector() * std::max(distance, object.w + settings.clearance);
+            });
+        }
+        else
+        {
+            float inner = SCENE_ROOM_HALF_EXTENT - settings.clearance;
+            camera.Position = place(scene, [&]() { return random.InBox(glm::vec3(-inner), glm::vec3(inner)); });
+            target = random.InBox(glm::vec3(-inner), glm::vec3(inner));
+            if (glm::length(target - camera.Position) < 1e-3f)
+                target = camera.Position + glm::vec3(0.0f, 0.0f, -1.0f);
+        }
+        camera.LookAt(target);
+    }
+
+private:
+    SceneRandom random;
+
+    static bool isObject(const SceneDrawList& scene, size_t i)
+    {
+        return (scene.flags[i] & (DRAW_REVERSE_NORMALS | DRAW_LIGHT)) == 0;
+    }
+
+    static unsigned int countObjects(const SceneDrawList& scene)
+    {
+        unsigned int count = 0;
+        for (size_t i = 0; i < scene.Size(); ++i)
+            count += isObject(scene, i) ? 1 : 0;
+        return count;
+    }
+
+    static glm::vec4 nthObject(const SceneDrawList& scene, unsigned int n)
+    {
+        for (size_t i = 0; i < scene.Size(); ++i)
+            if (isObject(scene, i) && n-- == 0)
+                return scene.bounds[i];
+        return glm::vec4(0.0f);
+    }
+
+    // how far eye is from being blocked: negative inside an object or outside the room
+    float freeSpace(const SceneDrawList& scene, const glm::vec3& eye) const
+    {
+        float free = SCENE_ROOM_HALF_EXTENT - std::max(std::fabs(eye.x), std::max(std::fabs(eye.y), std::fabs(eye.z)));
+        for (size_t i = 0; i < scene.Size(); ++i)
+            if (isObject(scene, i))
+                free = std::min(free, glm::length(eye - glm::vec3(scene.bounds[i])) - scene.bounds[i].w);
+        return free - settings.clearance;
+    }
+
+    // first candidate with room around it, or the one with the most
+    template <class Candidate>
+    glm::vec3 place(const SceneDrawList& scene, Candidate candidate)
+    {
+        glm::vec3 best(0.0f);
+        float bestFree = -1e30f;
+        for (unsigned int attempt = 0; attempt < settings.attempts; ++attempt)
+        {
+            glm::vec3 eye = candidate();
+            float free = freeSpace(scene, eye);
+            if (free > bestFree)
+            {
+                best = eye;
+                bestFree = free;
+            }
+            if (free >= 0.0f)
+                break;
+        }
+        // still outside the room: pull it back in
+        float inner = SCENE_ROOM_HALF_EXTENT - settings.clearance;
+        return glm::min(glm::max(best, glm::vec3(-inner)), glm::vec3(inner));
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "gl_ext.h"
+#include "geometry_arena.h"
+#include "render_queue.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <vector>
+
+// Per-frame list of arena draws. Per-draw data (model matrix and flags) lives in a texture buffer
+// indexed by the draw id attribute. Each pass radix sorts the draws by state (render_queue.h) and
+// submits every run that shares cull state, material and vertex array as one indirect command
+// list: a single glMultiDrawElementsIndirect on GL 4.3+, a tight loop of
+// glDrawElementsInstancedBaseVertex on plain 3.3. State is only touched between runs when it
+// changes. Draws outside a pass's frustum are left out; for the depth cube map every draw carries
+// the mask of faces it touches and the geometry shader only emits it to those. DrawViews submits
+// the list once for several cameras, each draw instanced per view (layered_views.h).
+
+enum DrawFlags {
+    DRAW_REVERSE_NORMALS = 1 << 0,  // light the inside of the surface (the room cube)
+    DRAW_LIGHT           = 1 << 1,  // unlit white, marks the light position
+    DRAW_ANOTHER         = 1 << 2,  // flat purple instead of the diffuse texture
+    DRAW_NO_CULL         = 1 << 3   // drawn with back face culling disabled
+};
+
+// texels per draw in the draw data buffer: 4 model matrix columns, then the flags (w: the
+// shadow cube map faces the draw touches, bit i for layer i)
+#define DRAW_DATA_TEXELS 5
+// texture unit the draw data buffer is bound to while a list is drawn
+#define DRAW_DATA_UNIT 2
+
+class SceneDrawList
+{
+public:
+    std::vector<const ArenaMesh*> meshes;
+    std::vector<glm::mat4>        models;
+    std::vector<unsigned int>     flags;
+    std::vector<unsigned int>     materials;    // diffuse texture, 0: the one the pass bound to unit 0
+    std::vector<glm::vec4>        bounds;       // world space bounding spheres
+    std::vector<unsigned int>     faceMasks;    // shadow cube map faces, see CullShadowFaces
+
+    void Clear()
+    {
+        meshes.clear();
+        models.clear();
+        flags.clear();
+        materials.clear();
+        bounds.clear();
+        faceMasks.clear();
+        materialKeys.Clear();
+    }
+
+    void Add(const ArenaMesh& mesh, const glm::mat4& model, unsigned int drawFlags = 0, unsigned int material = 0)
+    {
+        meshes.push_back(&mesh);
+        models.push_back(model);
+        flags.push_back(drawFlags);
+        materials.push_back(material);
+        bounds.push_back(worldBoundingSphere(mesh, model));
+        faceMasks.push_back(CUBE_FACES_ALL);
+    }
+
+    size_t Size() const { return meshes.size(); }
+
+    // draws submitted by the last Draw / DrawShadowFaces
+    size_t Drawn() const { return packets.size(); }
+
+    // works out which faces of a point light's depth cube map every draw lands in; call before
+    // Upload, the masks travel with the draw data
+    void CullShadowFaces(const glm::vec3& light, float nearPlane, float farPlane)
+    {
+        for (size_t i = 0; i < Size(); ++i)
+            faceMasks[i] = cubeFaceMask(light, bounds[i], nearPlane, farPlane);
+    }
+
+    // writes the per-draw data; call once after the list is complete and before any Draw()
+    void Upload(GeometryArena& arena)
+    {
+        if (texture == 0)
+        {
+            glGenBuffers(1, &dataBuffer);
+            glGenTextures(1, &texture);
+            glGenBuffers(1, &indirectBuffer);
+        }
+        staging.resize(Size() * DRAW_DATA_TEXELS);
+        for (size_t i = 0; i < Size(); ++i)
+        {
+            glm::vec4* texels = &staging[i * DRAW_DATA_TEXELS];
+            for (int c = 0; c < 4; ++c)
+                texels[c] = models[i][c];
+            texels[4] = glm::vec4(flags[i] & DRAW_REVERSE_NORMALS ? 1.0f : 0.0f,
+                                  flags[i] & DRAW_LIGHT ? 1.0f : 0.0f,
+                                  flags[i] & DRAW_ANOTHER ? 1.0f : 0.0f,
+                                  (float)faceMasks[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(staging.size(), 1) * sizeof(glm::vec4), staging.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        arena.ReserveDrawIds(Size());
+    }
+
+    // sorts and submits the list for one pass (levels of detail picked for view) with the pass's
+    // program in use, skipping draws outside frustum if one is given. Depth-only passes should ask
+    // for ARENA_STREAMS_POSITION: only positions are fetched and materials are ignored. Draws with
+    // a material leave it bound to unit 0.
+    void Draw(GeometryArena& arena, const LodView& view, ArenaStreams streams = ARENA_STREAMS_ALL, const Frustum* frustum = nullptr)
+    {
+        visible.resize(Size());
+        for (size_t i = 0; i < Size(); ++i)
+            visible[i] = !frustum || frustum->Intersects(bounds[i]);
+        submitVisible(arena, &view, 1, streams);
+    }
+
+    // one submission for viewCount views rendered into the layers of a texture array: every draw
+    // is instanced once per view (the draw id attribute advances every viewCount instances, so
+    // gl_InstanceID is the view), at the finest level any of the views needs, and is left out only
+    // when no view's frustum sees it
+    void DrawViews(GeometryArena& arena, const LodView* views, const Frustum* frusta, unsigned int viewCount, ArenaStreams streams = ARENA_STREAMS_ALL)
+    {
+        visible.resize(Size());
+        for (size_t i = 0; i < Size(); ++i)
+        {
+            visible[i] = 0;
+            for (unsigned int v = 0; v < viewCount && !visible[i]; ++v)
+                visible[i] = frusta[v].Intersects(bounds[i]);
+        }
+        submitVisible(arena, views, viewCount, streams);
+    }
+
+    // the layered depth cube map pass: only draws that touch a face (see CullShadowFaces)
+    void DrawShadowFaces(GeometryArena& arena, const LodView& view)
+    {
+        visible.resize(Size());
+        for (size_t i = 0; i < Size(); ++i)
+            visible[i] = faceMasks[i] != 0;
+        submitVisible(arena, &view, 1, ARENA_STREAMS_POSITION);
+    }
+
+private:
+    unsigned int dataBuffer = 0, texture = 0, indirectBuffer = 0;
+    std::vector<glm::vec4> staging;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<SortPacket> packets, scratch;
+    std::vector<const ArenaLod*> lods;
+    std::vector<unsigned char> visible;
+    SortKeyTable materialKeys;
+
+    void submitVisible(GeometryArena& arena, const LodView* views, unsigned int viewCount, ArenaStreams streams)
+    {
+        bool depthOnly = streams == ARENA_STREAMS_POSITION;
+        {
+            TRACE_ZONE("sort draws");
+            packets.clear();
+            lods.resize(Size());
+            for (size_t i = 0; i < Size(); ++i)
+            {
+                if (!visible[i])
+                    continue;
+                int lod = selectLod(*meshes[i], models[i], views[0]);
+                for (unsigned int v = 1; v < viewCount && lod > 0; ++v)
+                    lod = std::min(lod, selectLod(*meshes[i], models[i], views[v]));
+                lods[i] = &meshes[i]->lods[lod];
+                bool noCull = (flags[i] & DRAW_NO_CULL) != 0;
+                unsigned int material = depthOnly ? 0 : materialKeys.Index(materials[i]);
+                unsigned int vertexArray = lods[i]->indexType == GL_UNSIGNED_INT ? 1 : 0;
+                float distance = glm::length(glm::vec3(bounds[i]) - views[0].eye);
+                SortPacket packet;
+                packet.key = makeSortKey((unsigned int)streams, 0, noCull, material, vertexArray, sortKeyDepth(distance));
+                packet.index = (uint32_t)i;
+                packets.push_back(packet);
+            }
+            radixSortPackets(packets, scratch);
+        }
+        if (packets.empty())
+            return;
+
+        // commands in sorted order; a run of equal state keys is one multi draw
+        commands.resize(packets.size());
+        for (size_t p = 0; p < packets.size(); ++p)
+        {
+            const ArenaLod& lod = *lods[packets[p].index];
+            DrawElementsIndirectCommand& command = commands[p];
+            command.count = lod.indexCount;
+            command.instanceCount = viewCount;
+            command.firstIndex = lod.firstIndex;
+            command.baseVertex = lod.baseVertex;
+            command.baseInstance = packets[p].index;   // selects the draw id, and with it the draw data
+        }
+
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+        bool indirect = glext().MultiDrawElementsIndirect != nullptr;
+        if (indirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+
+        arena.SetDrawIdDivisor(viewCount);
+        RenderStateCache state;
+        for (size_t first = 0; first < packets.size();)
+        {
+            uint64_t key = packets[first].key;
+            size_t end = first + 1;
+            while (end < packets.size() && sortKeyState(packets[end].key) == sortKeyState(key))
+                ++end;
+            const SortPacket& packet = packets[first];
+            GLenum indexType = lods[packet.index]->indexType;
+            state.SetCulling(!sortKeyNoCull(key));
+            if (!depthOnly && materials[packet.index] != 0)
+                state.BindTexture(materials[packet.index]);
+            state.BindVertexArray(arena.VertexArray(streams, indexType));
+            submit(arena, first, end - first, indexType, indirect);
+            first = end;
+        }
+        state.SetCulling(true);
+
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        arena.SetDrawIdDivisor(1);
+    }
+
+    void submit(GeometryArena& arena, size_t first, size_t count, GLenum indexType, bool indirect)
+    {
+        if (indirect)
+        {
+            glext().MultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+            return;
+        }
+        // no base instance before 4.2: move the draw id attribute instead
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        for (size_t i = first; i < first + count; ++i)
+        {
+            const DrawElementsIndirectCommand& command = commands[i];
+            arena.SetDrawIdOffset(command.baseInstance);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, indexType, (void*)(command.firstIndex * indexSize), command.instanceCount, command.baseVertex);
+        }
+        arena.SetDrawIdOffset(0);
+    }
+};
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+/* Ring of raw frames in shared memory, written by the generator and read by a trainer process
+ * without encoding or touching the disk. C, so a consumer can include it (or load it through an FFI)
+ * without the rest of the generator.
+ *
+ * The mapping (/dev/shm/<name>, a named pagefile-backed mapping on Windows) is a header followed by
+ * slot_count slots of a slot header and slot_bytes of pixels. One writer and one reader: the writer
+ * publishes frames with increasing sequence numbers into slot sequence % slot_count, and each slot
+ * moves EMPTY -> WRITING -> READY (writer) -> READING -> EMPTY (reader) with atomic compare and
+ * swaps, so neither side ever blocks the other or sees a half written frame. A full ring either
+ * holds the writer back (it retries) or, when it overwrites, drops the oldest unread frames, which
+ * the reader counts.
+ *
+ * Reader:
+ *
+ *     frame_ring ring;
+ *     frame_ring_frame frame;
+ *     if (frame_ring_open(&ring, FRAME_RING_NAME)) {
+ *         for (;;) {
+ *             if (!frame_ring_acquire(&ring, &frame)) { sleep a little; continue; }
+ *             use frame.pixels: frame.height rows of frame.width RGB8 pixels, top row first
+ *             frame_ring_release(&ring, &frame);
+ *         }
+ *         frame_ring_close(&ring);
+ *     }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define FRAME_RING_NAME "shadow_frames"
+#define FRAME_RING_MAGIC 0x474E5246u    /* "FRNG" */
+#define FRAME_RING_VERSION 1u
+#define FRAME_RING_ALIGNMENT 4096u      /* slots start on their own pages */
+
+#define FRAME_SLOT_EMPTY 0u
+#define FRAME_SLOT_WRITING 1u
+#define FRAME_SLOT_READY 2u
+#define FRAME_SLOT_READING 3u
+
+#define FRAME_RING_RGB8 0u
+
+/* atomics on the shared words */
+#ifdef _MSC_VER
+#define FRAME_RING_LOAD32(p) ((uint32_t)_InterlockedOr((volatile long*)(p), 0))
+#define FRAME_RING_STORE32(p, v) ((void)_InterlockedExchange((volatile long*)(p), (long)(v)))
+#define FRAME_RING_CAS32(p, expected, desired) ((uint32_t)_InterlockedCompareExchange((volatile long*)(p), (long)(desired), (long)(expected)) == (expected))
+#define FRAME_RING_LOAD64(p) ((uint64_t)_InterlockedOr64((volatile long long*)(p), 0))
+#define FRAME_RING_STORE64(p, v) ((void)_InterlockedExchange64((volatile long long*)(p), (long long)(v)))
+#else
+#define FRAME_RING_LOAD32(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define FRAME_RING_STORE32(p, v) __atomic_store_n((p), (uint32_t)(v), __ATOMIC_RELEASE)
+#define FRAME_RING_CAS32(p, expected, desired) frame_ring_cas32((p), (expected), (desired))
+#define FRAME_RING_LOAD64(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define FRAME_RING_STORE64(p, v) __atomic_store_n((p), (uint64_t)(v), __ATOMIC_RELEASE)
+static inline int frame_ring_cas32(uint32_t* p, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_bytes;        /* pixel capacity of a slot */
+    uint64_t slot_stride;       /* slot header and pixels, page aligned */
+    uint64_t slots_offset;      /* first slot from the start of the mapping */
+    uint64_t write_sequence;    /* frames published so far; written by the writer only */
+    uint64_t dropped;           /* frames the writer couldn't publish (full ring without overwriting) */
+} frame_ring_header;
+
+typedef struct {
+    uint32_t state;             /* FRAME_SLOT_* */
+    uint32_t format;            /* FRAME_RING_RGB8 */
+    uint64_t sequence;          /* of the frame in the slot */
+    uint64_t sample_id;         /* the generator's manifest id */
+    int32_t width, height;
+    uint32_t bytes;
+    uint32_t reserved;
+} frame_ring_slot;
+
+/* what the writer attaches to a frame */
+typedef struct {
+    uint64_t sample_id;
+    int32_t width, height;
+    uint32_t bytes;
+} frame_ring_frame_info;
+
+/* a frame held by the reader between acquire and release */
+typedef struct {
+    const unsigned char* pixels;
+    uint64_t sequence, sample_id;
+    int32_t width, height;
+    uint32_t bytes;
+    frame_ring_slot* slot;
+} frame_ring_frame;
+
+typedef struct {
+    unsigned char* base;
+    size_t size;
+    frame_ring_header* header;
+    uint64_t next;              /* reader: sequence it wants next */
+    uint64_t skipped;           /* reader: frames overwritten before it got to them */
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} frame_ring;
+
+static inline frame_ring_slot* frame_ring_slot_at(const frame_ring* ring, uint64_t sequence)
+{
+    const frame_ring_header* h = ring->header;
+    return (frame_ring_slot*)(ring->base + h->slots_offset + (sequence % h->slot_count) * h->slot_stride);
+}
+
+static inline void frame_ring_name(char* path, size_t size, const char* name)
+{
+#ifdef _WIN32
+    snprintf(path, size, "Local\\%s", name);
+#else
+    snprintf(path, size, "/dev/shm/%s", name);
+#endif
+}
+
+static inline void frame_ring_close(frame_ring* ring)
+{
+#ifdef _WIN32
+    if (ring->base)
+        UnmapViewOfFile(ring->base);
+    if (ring->mapping)
+        CloseHandle(ring->mapping);
+    ring->mapping = NULL;
+#else
+    if (ring->base)
+        munmap(ring->base, ring->size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    ring->fd = -1;
+#endif
+    ring->base = NULL;
+    ring->header = NULL;
+}
+
+/* maps size bytes of the named region; create makes (or resizes) it first */
+static inline int frame_ring_map(frame_ring* ring, const char* name, size_t size, int create)
+{
+    char path[256];
+    memset(ring, 0, sizeof(*ring));
+    frame_ring_name(path, sizeof(path), name);
+#ifdef _WIN32
+    if (create)
+        ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, path);
+    else
+        ring->mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path);
+    if (!ring->mapping)
+        return 0;
+    ring->base = (unsigned char*)MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+    ring->fd = open(path, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+    if (ring->fd < 0)
+        return 0;
+    if (create && ftruncate(ring->fd, (off_t)size) != 0) {
+        frame_ring_close(ring);
+        return 0;
+    }
+    if (!create) {
+        struct stat info;
+        if (fstat(ring->fd, &info) != 0 || (size_t)info.st_size < size) {
+            frame_ring_close(ring);
+            return 0;
+        }
+    }
+    ring->base = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (ring->base == (unsigned char*)MAP_FAILED)
+        ring->base = NULL;
+#endif
+    if (!ring->base) {
+        frame_ring_close(ring);
+        return 0;
+    }
+    ring->size = size;
+    ring->header = (frame_ring_header*)ring->base;
+    return 1;
+}
+
+/* writer: a fresh ring of slot_count frames of up to slot_bytes each; 0 on failure */
+static inline int frame_ring_create(frame_ring* ring, const char* name, uint32_t slot_count, uint32_t slot_bytes)
+{
+    uint64_t stride = (sizeof(frame_ring_slot) + (uint64_t)slot_bytes + FRAME_RING_ALIGNMENT - 1) / FRAME_RING_ALIGNMENT * FRAME_RING_ALIGNMENT;
+    uint64_t offset = FRAME_RING_ALIGNMENT;
+    if (slot_count == 0 || !frame_ring_map(ring, name, (size_t)(offset + stride * slot_count), 1))
+        return 0;
+    memset(ring->base, 0, ring->size);
+    ring->header->version = FRAME_RING_VERSION;
+    ring->header->slot_count = slot_count;
+    ring->header->slot_bytes = slot_bytes;
+    ring->header->slot_stride = stride;
+    ring->header->slots_offset = offset;
+    /* published last, so a reader only accepts a complete header */
+    FRAME_RING_STORE32(&ring->header->magic, FRAME_RING_MAGIC);
+    return 1;
+}
+
+/* reader: attaches to the writer's ring and starts at the oldest frame still in it */
+static inline int frame_ring_open(frame_ring* ring, const char* name)
+{
+    frame_ring_header header;
+    uint64_t written, s;
+    if (!frame_ring_map(ring, name, sizeof(frame_ring_header), 0))
+        return 0;
+    header = *ring->header;
+    frame_ring_close(ring);
+    if (header.magic != FRAME_RING_MAGIC || header.version != FRAME_RING_VERSION || header.slot_count == 0)
+        return 0;
+    if (!frame_ring_map(ring, name, (size_t)(header.slots_offset + header.slot_stride * header.slot_count), 0))
+        return 0;
+    written = FRAME_RING_LOAD64(&ring->header->write_sequence);
+    ring->next = written > header.slot_count ? written - header.slot_count : 0;
+    /* slots an earlier reader died holding */
+    for (s = 0; s < header.slot_count; ++s)
+        FRAME_RING_CAS32(&frame_ring_slot_at(ring, s)->state, FRAME_SLOT_READING, FRAME_SLOT_READY);
+    return 1;
+}
+
+/* writer: pixel memory of the next slot, or NULL while that slot holds a frame the reader hasn't
+ * released (and, unless overwrite, one it hasn't read yet) */
+static inline unsigned char* frame_ring_begin(frame_ring* ring, int overwrite)
+{
+    frame_ring_slot* slot = frame_ring_slot_at(ring, ring->header->write_sequence);
+    if (!FRAME_RING_CAS32(&slot->state, FRAME_SLOT_EMPTY, FRAME_SLOT_WRITING) &&
+        !(overwrite && FRAME_RING_CAS32(&slot->state, FRAME_SLOT_READY, FRAME_SLOT_WRITING)))
+        return NULL;
+    return (unsigned char*)(slot + 1);
+}
+
+/* writer: publishes the frame written since frame_ring_begin */
+static inline void frame_ring_commit(frame_ring* ring, const frame_ring_frame_info* info)
+{
+    uint64_t sequence = ring->header->write_sequence;
+    frame_ring_slot* slot = frame_ring_slot_at(ring, sequence);
+    slot->format = FRAME_RING_RGB8;
+    slot->sequence = sequence;
+    slot->sample_id = info->sample_id;
+    slot->width = info->width;
+    slot->height = info->height;
+    slot->bytes = info->bytes;
+    FRAME_RING_STORE32(&slot->state, FRAME_SLOT_READY);
+    FRAME_RING_STORE64(&ring->header->write_sequence, sequence + 1);
+}
+
+/* writer: a frame that didn't fit in the ring */
+static inline void frame_ring_drop(frame_ring* ring)
+{
+    FRAME_RING_STORE64(&ring->header->dropped, ring->header->dropped + 1);
+}
+
+/* reader: the next published frame, held until frame_ring_release; 0 when there is none yet */
+static inline int frame_ring_acquire(frame_ring* ring, frame_ring_frame* frame)
+{
+    uint32_t count = ring->header->slot_count;
+    uint64_t written = FRAME_RING_LOAD64(&ring->header->write_sequence);
+    if (ring->next + count < written) {
+        ring->skipped += written - count - ring->next;
+        ring->next = written - count;
+    }
+    while (ring->next < written) {
+        frame_ring_slot* slot = frame_ring_slot_at(ring, ring->next);
+        if (FRAME_RING_CAS32(&slot->state, FRAME_SLOT_READY, FRAME_SLOT_READING)) {
+            if (slot->sequence == ring->next) {
+                frame->pixels = (const unsigned char*)(slot + 1);
+                frame->sequence = slot->sequence;
+                frame->sample_id = slot->sample_id;
+                frame->width = slot->width;
+                frame->height = slot->height;
+                frame->bytes = slot->bytes;
+                frame->slot = slot;
+                return 1;
+            }
+            /* the writer already replaced it with a later frame */
+            FRAME_RING_STORE32(&slot->state, FRAME_SLOT_READY);
+        }
+        /* overwritten, or being overwritten right now */
+        ++ring->next;
+        ++ring->skipped;
+    }
+    return 0;
+}
+
+/* reader: hands the frame's slot back to the writer */
+static inline void frame_ring_release(frame_ring* ring, frame_ring_frame* frame)
+{
+    FRAME_RING_STORE32(&frame->slot->state, FRAME_SLOT_EMPTY);
+    frame->slot = NULL;
+    frame->pixels = NULL;
+    ring->next = frame->sequence + 1;
+}
+
+#endif
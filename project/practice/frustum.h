@@ -0,0 +1,71 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// View volume tests for bounding spheres (xyz center, w radius), used to keep objects out of the
+// passes and cube map faces they can't show up in.
+
+class Frustum
+{
+public:
+    glm::vec4 planes[6];    // inward facing, normalized: dot(xyz, p) + w >= 0 inside
+
+    Frustum() {}
+
+    // planes of a projection * view matrix (Gribb & Hartmann)
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[0] = row3 + row0;    // left
+        planes[1] = row3 - row0;    // right
+        planes[2] = row3 + row1;    // bottom
+        planes[3] = row3 - row1;    // top
+        planes[4] = row3 + row2;    // near
+        planes[5] = row3 - row2;    // far
+        for (glm::vec4& plane : planes)
+            plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+    }
+
+    bool Intersects(const glm::vec4& sphere) const
+    {
+        for (const glm::vec4& plane : planes)
+            if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+                return false;
+        return true;
+    }
+};
+
+// cube map faces (+X, -X, +Y, -Y, +Z, -Z, bit i for layer i) a sphere overlaps, for the 90 degree
+// frusta of a point light's depth cube map. A face's side planes are the diagonals |u| = major
+// axis, which gives each test a closed form.
+inline unsigned int cubeFaceMask(const glm::vec3& light, const glm::vec4& sphere, float nearPlane, float farPlane)
+{
+    const float invSqrt2 = 0.70710678f;
+    glm::vec3 d = glm::vec3(sphere) - light;
+    float radius = sphere.w;
+    if (glm::length(d) - radius > farPlane)
+        return 0;
+    unsigned int mask = 0;
+    for (int face = 0; face < 6; ++face)
+    {
+        int axis = face / 2;
+        float major = (face & 1) ? -d[axis] : d[axis];
+        float u = d[(axis + 1) % 3], v = d[(axis + 2) % 3];
+        if (major + radius < nearPlane)
+            continue;
+        if ((major - std::fabs(u)) * invSqrt2 < -radius || (major - std::fabs(v)) * invSqrt2 < -radius)
+            continue;
+        mask |= 1u << face;
+    }
+    return mask;
+}
+
+#define CUBE_FACES_ALL 0x3fu
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Indexed procedural primitives, generated per tessellation level, counter-clockwise wound when
+// seen from outside and reordered for the post-transform cache. GeometryLibrary (geometry_arena.h)
+// uploads them on first use.
+
+enum Primitive {
+    PRIMITIVE_CUBE,
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_CONE,
+    PRIMITIVE_TRIANGULAR_PRISM,
+    PRIMITIVE_COUNT
+};
+
+// level 0 is the finest tessellation
+#define GEOMETRY_LOD_COUNT 4
+static const int sphereLodSlices[GEOMETRY_LOD_COUNT] = { 48, 32, 16, 8 };
+static const int coneLodSegments[GEOMETRY_LOD_COUNT] = { 48, 32, 16, 8 };
+
+// same interleaved position/normal/texcoord layout the shaders have always used
+struct GeometryVertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+struct GeometryData {
+    std::vector<GeometryVertex> vertices;
+    std::vector<unsigned int>   indices;
+    float radius = 0.0f;    // object space bounding sphere around the origin
+    float error = 0.0f;     // largest distance between the tessellation and the true surface
+};
+
+// pixels covered by one world unit at distance 1 for the view a LOD is picked for
+// allowed screen space deviation of a silhouette before a finer level is chosen
+#define GEOMETRY_LOD_PIXEL_ERROR 0.5f
+// the same for shadow maps: a shadow edge is blurred by filtering anyway, so it may be coarser
+#define GEOMETRY_SHADOW_LOD_PIXEL_ERROR 2.0f
+
+struct LodView {
+    glm::vec3 eye = glm::vec3(0.0f);
+    float pixelsPerUnit = 0.0f;     // 0 disables LOD selection (always the finest level)
+    float pixelError = GEOMETRY_LOD_PIXEL_ERROR;
+
+    LodView() {}
+    LodView(const glm::vec3& eye, float fovyRadians, float viewportHeight, float pixelError = GEOMETRY_LOD_PIXEL_ERROR)
+        : eye(eye), pixelsPerUnit(viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f))), pixelError(pixelError) {}
+};
+
+// ----------------------------------------------------------------------------
+// generators
+// ----------------------------------------------------------------------------
+
+inline void geometryFinalize(GeometryData& data)
+{
+    float radius = 0.0f;
+    for (const GeometryVertex& v : data.vertices)
+        radius = std::max(radius, glm::length(v.Position));
+    data.radius = radius;
+    optimizeVertexCache(data.indices.data(), data.indices.size(), data.vertices.size());
+}
+
+// 2x2x2 cube centered at the origin, 4 vertices per face so normals and uvs stay flat
+inline GeometryData buildCube()
+{
+    GeometryData data;
+    data.vertices.reserve(24);
+    data.indices.reserve(36);
+    const glm::vec3 normals[6] = {
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)
+    };
+    for (int face = 0; face < 6; ++face)
+    {
+        glm::vec3 n = normals[face];
+        // u x v == n, so (-u,-v) (u,-v) (u,v) (-u,v) is counter-clockwise seen from outside
+        glm::vec3 u = std::fabs(n.y) > 0.5f ? glm::vec3(n.y, 0.0f, 0.0f) : glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), n);
+        glm::vec3 v = glm::cross(n, u);
+        unsigned int base = (unsigned int)data.vertices.size();
+        const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+        for (int c = 0; c < 4; ++c)
+        {
+            GeometryVertex vertex;
+            vertex.Position = n + u * corners[c][0] + v * corners[c][1];
+            vertex.Normal = n;
+            vertex.TexCoords = glm::vec2(corners[c][0] * 0.5f + 0.5f, corners[c][1] * 0.5f + 0.5f);
+            data.vertices.push_back(vertex);
+        }
+        const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0; i < 6; ++i)
+            data.indices.push_back(base + quad[i]);
+    }
+    geometryFinalize(data);
+    return data;
+}
+
+// unit sphere with its poles on the z axis (the orientation renderSphere always used)
+inline GeometryData buildSphere(int slices, int stacks)
+{
+    GeometryData data;
+    data.vertices.reserve((slices + 1) * (stacks + 1));
+    data.indices.reserve(slices * (stacks - 1) * 6);
+    for (int stack = 0; stack <= stacks; ++stack)
+    {
+        float phi = glm::pi<float>() * stack / stacks;
+        for (int slice = 0; slice <= slices; ++slice)
+        {
+            float theta = glm::two_pi<float>() * slice / slices;
+            GeometryVertex vertex;
+            vertex.Normal = glm::vec3(std::cos(theta) * std::sin(phi), std::sin(theta) * std::sin(phi), std::cos(phi));
+            vertex.Position = vertex.Normal;
+            vertex.TexCoords = glm::vec2((float)slice / slices, (float)stack / stacks);
+            data.vertices.push_back(vertex);
+        }
+    }
+    for (int stack = 0; stack < stacks; ++stack)
+    {
+        for (int slice = 0; slice < slices; ++slice)
+        {
+            unsigned int a = stack * (slices + 1) + slice;
+            unsigned int b = a + slices + 1;
+            // the first and last stacks collapse to a single triangle at the pole
+            if (stack != 0)
+            {
+                data.indices.push_back(a);
+                data.indices.push_back(b);
+                data.indices.push_back(a + 1);
+            }
+            if (stack != stacks - 1)
+            {
+                data.indices.push_back(a + 1);
+                data.indices.push_back(b);
+                data.indices.push_back(b + 1);
+            }
+        }
+    }
+    geometryFinalize(data);
+    // sagitta of the coarsest direction (stacks cover half the angle with half the segments)
+    data.error = 1.0f - std::cos(glm::pi<float>() / std::min(slices, stacks * 2));
+    return data;
+}
+
+// cone of height 1 and radius 0.5 centered at the origin, apex up, with a closed base
+inline GeometryData buildCone(int segments)
+{
+    const float height = 1.0f;
+    const float radius = 0.5f;
+    GeometryData data;
+    data.vertices.reserve((segments + 1) * 2 + segments + 1);
+    data.indices.reserve(segments * 6);
+
+    // side: one ring vertex and one apex vertex per segment boundary so normals stay smooth
+    float slope = radius / height;
+    for (int i = 0; i <= segments; ++i)
+    {
+        float theta = glm::two_pi<float>() * i / segments;
+        float c = std::cos(theta), s = std::sin(theta);
+        glm::vec3 normal = glm::normalize(glm::vec3(c, slope, s));
+        GeometryVertex ring;
+        ring.Position = glm::vec3(radius * c, -height * 0.5f, radius * s);
+        ring.Normal = normal;
+        ring.TexCoords = glm::vec2((float)i / segments, 0.0f);
+        data.vertices.push_back(ring);
+
+        float mid = glm::two_pi<float>() * (i + 0.5f) / segments;
+        GeometryVertex apex;
+        apex.Position = glm::vec3(0.0f, height * 0.5f, 0.0f);
+        apex.Normal = glm::normalize(glm::vec3(std::cos(mid), slope, std::sin(mid)));
+        apex.TexCoords = glm::vec2((i + 0.5f) / segments, 1.0f);
+        data.vertices.push_back(apex);
+    }
+    for (int i = 0; i < segments; ++i)
+    {
+        unsigned int ring = i * 2, apex = i * 2 + 1, next = (i + 1) * 2;
+        data.indices.push_back(ring);
+        data.indices.push_back(apex);
+        data.indices.push_back(next);
+    }
+
+    // base cap facing down
+    unsigned int center = (unsigned int)data.vertices.size();
+    GeometryVertex base;
+    base.Position = glm::vec3(0.0f, -height * 0.5f, 0.0f);
+    base.Normal = glm::vec3(0.0f, -1.0f, 0.0f);
+    base.TexCoords = glm::vec2(0.5f, 0.5f);
+    data.vertices.push_back(base);
+    for (int i = 0; i < segments; ++i)
+    {
+        float theta = glm::two_pi<float>() * i / segments;
+        GeometryVertex rim;
+        rim.Position = glm::vec3(radius * std::cos(theta), -height * 0.5f, radius * std::sin(theta));
+        rim.Normal = base.Normal;
+        rim.TexCoords = glm::vec2(0.5f + 0.5f * std::cos(theta), 0.5f + 0.5f * std::sin(theta));
+        data.vertices.push_back(rim);
+    }
+    for (int i = 0; i < segments; ++i)
+    {
+        data.indices.push_back(center);
+        data.indices.push_back(center + 1 + i);
+        data.indices.push_back(center + 1 + (i + 1) % segments);
+    }
+    geometryFinalize(data);
+    data.error = radius * (1.0f - std::cos(glm::pi<float>() / segments));
+    return data;
+}
+
+// single triangle in the xz plane, double sided so it survives back face culling from either side
+inline GeometryData buildTriangle()
+{
+    const glm::vec3 corners[3] = { glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.5f, 0.0f, -0.5f) };
+    const glm::vec2 uvs[3] = { glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 1.0f), glm::vec2(1.0f, 0.0f) };
+    GeometryData data;
+    for (int side = 0; side < 2; ++side)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            GeometryVertex vertex;
+            vertex.Position = corners[i];
+            vertex.Normal = glm::vec3(0.0f, side == 0 ? 1.0f : -1.0f, 0.0f);
+            vertex.TexCoords = uvs[i];
+            data.vertices.push_back(vertex);
+        }
+    }
+    const unsigned int indices[6] = { 0, 1, 2, 3, 5, 4 };
+    data.indices.assign(indices, indices + 6);
+    geometryFinalize(data);
+    return data;
+}
+
+// the base triangle of buildTriangle() extruded to a height of 1
+inline GeometryData buildTriangularPrism()
+{
+    const float height = 1.0f;
+    const glm::vec3 corners[3] = { glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.5f, 0.0f, -0.5f) };
+    const glm::vec3 up(0.0f, height, 0.0f);
+    GeometryData data;
+    data.vertices.reserve(18);
+    data.indices.reserve(24);
+    auto add = [&](const glm::vec3& p, const glm::vec3& n, const glm::vec2& uv) {
+        GeometryVertex vertex;
+        vertex.Position = p;
+        vertex.Normal = n;
+        vertex.TexCoords = uv;
+        data.vertices.push_back(vertex);
+        return (unsigned int)data.vertices.size() - 1;
+    };
+    // caps (corners are counter-clockwise seen from above)
+    unsigned int b[3], t[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec2 uv(corners[i].x + 0.5f, corners[i].z + 0.5f);
+        b[i] = add(corners[i], glm::vec3(0.0f, -1.0f, 0.0f), uv);
+        t[i] = add(corners[i] + up, glm::vec3(0.0f, 1.0f, 0.0f), uv);
+    }
+    const unsigned int caps[6] = { b[0], b[2], b[1], t[0], t[1], t[2] };
+    data.indices.insert(data.indices.end(), caps, caps + 6);
+    // sides
+    for (int i = 0; i < 3; ++i)
+    {
+        glm::vec3 p0 = corners[i], p1 = corners[(i + 1) % 3];
+        glm::vec3 n = glm::normalize(glm::cross(p1 - p0, up));
+        unsigned int q0 = add(p0, n, glm::vec2(0.0f, 0.0f));
+        unsigned int q1 = add(p1, n, glm::vec2(1.0f, 0.0f));
+        unsigned int q2 = add(p1 + up, n, glm::vec2(1.0f, 1.0f));
+        unsigned int q3 = add(p0 + up, n, glm::vec2(0.0f, 1.0f));
+        const unsigned int quad[6] = { q0, q1, q2, q0, q2, q3 };
+        data.indices.insert(data.indices.end(), quad, quad + 6);
+    }
+    geometryFinalize(data);
+    return data;
+}
+
+inline GeometryData buildPrimitive(Primitive primitive, int lod)
+{
+    switch (primitive)
+    {
+    case PRIMITIVE_CUBE: return buildCube();
+    case PRIMITIVE_SPHERE: return buildSphere(sphereLodSlices[lod], sphereLodSlices[lod] / 2);
+    case PRIMITIVE_TRIANGLE: return buildTriangle();
+    case PRIMITIVE_CONE: return buildCone(coneLodSegments[lod]);
+    case PRIMITIVE_TRIANGULAR_PRISM: return buildTriangularPrism();
+    default: return GeometryData();
+    }
+}
+
+// flat primitives are exact at every level, so they only get level 0
+inline bool primitiveHasLods(Primitive primitive)
+{
+    return primitive == PRIMITIVE_SPHERE || primitive == PRIMITIVE_CONE;
+}
+
+#endif
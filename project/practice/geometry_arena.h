@@ -0,0 +1,333 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+#include "linear_arena.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <vector>
+
+// Two vertex streams (positions, packed attributes) and two index pools (16 and 32 bit) that every
+// piece of static geometry (procedural primitives and imported meshes) is sub-allocated from.
+// Indices are stored relative to their mesh, so a draw only needs (firstIndex, count, baseVertex)
+// and the index type; one VAO per (stream set, index type) describes the whole arena.
+
+#define ARENA_MAX_LODS 4
+#define ARENA_INITIAL_VERTICES (64 * 1024)
+#define ARENA_INITIAL_INDICES (192 * 1024)
+// vertex attribute carrying the per-draw index, fed from the draw id buffer with divisor 1
+#define ARENA_DRAW_ID_ATTRIBUTE 3
+// packed normal + half float texture coords, 8 bytes next to the 12 byte position
+#define ARENA_VERTEX_FORMAT VERTEX_FORMAT_COMPACT
+
+// which streams a vertex array fetches
+enum ArenaStreams {
+    ARENA_STREAMS_ALL,          // position + normal + texture coords
+    ARENA_STREAMS_POSITION      // position only, for depth passes
+};
+
+struct ArenaLod {
+    GLint  baseVertex = 0;
+    GLuint firstIndex = 0;      // in elements of indexType, within that type's pool
+    GLuint indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    float  error = 0.0f;        // object space deviation from level 0
+};
+
+struct ArenaMesh {
+    ArenaLod lods[ARENA_MAX_LODS];
+    int      lodCount = 0;
+    glm::vec3 center = glm::vec3(0.0f);    // object space bounding sphere
+    float    radius = 0.0f;
+};
+
+// bounding sphere of a mesh placed with model: xyz center, w radius (world space)
+inline glm::vec4 worldBoundingSphere(const ArenaMesh& mesh, const glm::mat4& model)
+{
+    float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    return glm::vec4(glm::vec3(model * glm::vec4(mesh.center, 1.0f)), mesh.radius * scale);
+}
+
+// coarsest level whose error, projected at the mesh's nearest point, stays under the view's
+// pixel error
+inline int selectLod(const ArenaMesh& mesh, const glm::mat4& model, const LodView& view)
+{
+    if (mesh.lodCount <= 1 || view.pixelsPerUnit <= 0.0f)
+        return 0;
+    glm::vec4 sphere = worldBoundingSphere(mesh, model);
+    float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    float distance = std::max(glm::length(glm::vec3(sphere) - view.eye) - sphere.w, 1e-3f);
+    float pixelsPerObjectUnit = view.pixelsPerUnit * scale / distance;
+    for (int lod = mesh.lodCount - 1; lod > 0; --lod)
+        if (mesh.lods[lod].error * pixelsPerObjectUnit <= view.pixelError)
+            return lod;
+    return 0;
+}
+
+class GeometryArena
+{
+public:
+    // appends a mesh and returns its range; meshes of up to 65536 vertices get 16 bit indices.
+    // The buffers grow (on the GPU) when they run out.
+    ArenaLod Add(const GeometryVertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+    {
+        if (positionVBO == 0)
+            init();
+        int pool = vertexCount <= 65536 ? 0 : 1;
+        reserve(vertexUsed + vertexCount, pool, indexUsed[pool] + indexCount);
+
+        ArenaLod range;
+        range.baseVertex = (GLint)vertexUsed;
+        range.firstIndex = (GLuint)indexUsed[pool];
+        range.indexCount = (GLuint)indexCount;
+        range.indexType = pool == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        LinearArenaScope scope(LinearArena::Staging());
+        glm::vec3* positions = LinearArena::Staging().Allocate<glm::vec3>(vertexCount);
+        unsigned char* attributes = LinearArena::Staging().Allocate<unsigned char>(vertexCount * layout.stride);
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            positions[i] = vertices[i].Position;
+            writeVertexAttributes(&attributes[i * layout.stride], layout, ARENA_VERTEX_FORMAT, vertices[i].Normal, vertices[i].TexCoords);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, vertexUsed * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3), positions);
+        glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+        glBufferSubData(GL_ARRAY_BUFFER, vertexUsed * layout.stride, vertexCount * layout.stride, attributes);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        uploadIndices(pool, indices, indexCount);
+        vertexUsed += vertexCount;
+        return range;
+    }
+
+    // another index buffer over the vertices of an earlier Add (a level of detail)
+    ArenaLod AddIndices(const ArenaLod& base, const unsigned int* indices, size_t indexCount)
+    {
+        int pool = base.indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+        reserve(vertexUsed, pool, indexUsed[pool] + indexCount);
+
+        ArenaLod range = base;
+        range.firstIndex = (GLuint)indexUsed[pool];
+        range.indexCount = (GLuint)indexCount;
+        range.error = 0.0f;
+        uploadIndices(pool, indices, indexCount);
+        return range;
+    }
+
+    // vertex array for a stream set with the index pool of indexType bound
+    unsigned int VertexArray(ArenaStreams streams, GLenum indexType = GL_UNSIGNED_INT)
+    {
+        if (positionVBO == 0)
+            init();
+        return VAO[streams][indexType == GL_UNSIGNED_SHORT ? 0 : 1];
+    }
+
+    // makes sure draw ids 0..count-1 can be fetched through ARENA_DRAW_ID_ATTRIBUTE
+    void ReserveDrawIds(size_t count)
+    {
+        if (positionVBO == 0)
+            init();
+        if (count <= drawIdCount)
+            return;
+        size_t capacity = std::max(count, drawIdCount * 2);
+        std::vector<GLuint> ids(capacity);
+        for (size_t i = 0; i < capacity; ++i)
+            ids[i] = (GLuint)i;
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        drawIdCount = capacity;
+    }
+
+    // points the bound vertex array's draw id attribute at an offset; used where base instance
+    // can't be passed to the draw
+    void SetDrawIdOffset(GLuint first)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glVertexAttribIPointer(ARENA_DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)(first * sizeof(GLuint)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // instances that share a draw id: 1 normally, the view count for layered multi-view draws
+    // where each instance of a draw is one view (layered_views.h)
+    void SetDrawIdDivisor(GLuint divisor)
+    {
+        if (positionVBO == 0)
+            init();
+        if (divisor == drawIdDivisor)
+            return;
+        for (int streams = 0; streams < 2; ++streams)
+            for (int pool = 0; pool < 2; ++pool)
+            {
+                glBindVertexArray(VAO[streams][pool]);
+                glVertexAttribDivisor(ARENA_DRAW_ID_ATTRIBUTE, divisor);
+            }
+        glBindVertexArray(0);
+        drawIdDivisor = divisor;
+    }
+
+    size_t VertexCount() const { return vertexUsed; }
+    size_t IndexCount() const { return indexUsed[0] + indexUsed[1]; }
+    // bytes fetched per vertex by a vertex array
+    size_t VertexBytes(ArenaStreams streams) const
+    {
+        return sizeof(glm::vec3) + (streams == ARENA_STREAMS_ALL ? (size_t)layout.stride : 0);
+    }
+
+private:
+    unsigned int VAO[2][2] = { { 0, 0 }, { 0, 0 } };   // [ArenaStreams][short, wide indices]
+    unsigned int positionVBO = 0, attributeVBO = 0, EBO[2] = { 0, 0 }, drawIdVBO = 0;
+    VertexStreamLayout layout = vertexStreamLayout(ARENA_VERTEX_FORMAT, false);
+    size_t vertexCapacity = 0, indexCapacity[2] = { 0, 0 };
+    size_t vertexUsed = 0, indexUsed[2] = { 0, 0 };
+    size_t drawIdCount = 0;
+    GLuint drawIdDivisor = 1;
+
+    void init()
+    {
+        glGenVertexArrays(4, &VAO[0][0]);
+        glGenBuffers(1, &positionVBO);
+        glGenBuffers(1, &attributeVBO);
+        glGenBuffers(2, EBO);
+        glGenBuffers(1, &drawIdVBO);
+        vertexCapacity = ARENA_INITIAL_VERTICES;
+        indexCapacity[0] = indexCapacity[1] = ARENA_INITIAL_INDICES;
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(glm::vec3), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * layout.stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO[0]);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity[0] * sizeof(GLushort), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO[1]);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity[1] * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        ReserveDrawIds(256);
+        setupVertexArrays();
+    }
+
+    // appends to an index pool (capacity reserved by the caller)
+    void uploadIndices(int pool, const unsigned int* indices, size_t indexCount)
+    {
+        size_t indexSize = pool == 0 ? sizeof(GLushort) : sizeof(GLuint);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO[pool]);
+        if (pool == 0)
+        {
+            LinearArenaScope scope(LinearArena::Staging());
+            GLushort* shortIndices = LinearArena::Staging().Allocate<GLushort>(indexCount);
+            std::copy(indices, indices + indexCount, shortIndices);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexUsed[pool] * indexSize, indexCount * indexSize, shortIndices);
+        }
+        else
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexUsed[pool] * indexSize, indexCount * indexSize, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        indexUsed[pool] += indexCount;
+    }
+
+    void setupVertexArrays()
+    {
+        for (int streams = 0; streams < 2; ++streams)
+            for (int pool = 0; pool < 2; ++pool)
+            {
+                glBindVertexArray(VAO[streams][pool]);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO[pool]);
+                // vertex positions
+                glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+                // vertex normals and texture coords
+                if (streams == ARENA_STREAMS_ALL)
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+                    setVertexAttributePointers(layout, ARENA_VERTEX_FORMAT);
+                }
+                // draw id
+                glEnableVertexAttribArray(ARENA_DRAW_ID_ATTRIBUTE);
+                SetDrawIdOffset(0);
+                glVertexAttribDivisor(ARENA_DRAW_ID_ATTRIBUTE, 1);
+            }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // grows a buffer by copying its used range into a larger one on the GPU
+    static void grow(unsigned int& buffer, size_t usedBytes, size_t newBytes)
+    {
+        unsigned int bigger;
+        glGenBuffers(1, &bigger);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        if (usedBytes > 0)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = bigger;
+    }
+
+    void reserve(size_t vertices, int pool, size_t indices)
+    {
+        bool changed = false;
+        if (vertices > vertexCapacity)
+        {
+            size_t capacity = std::max(vertices, vertexCapacity * 2);
+            grow(positionVBO, vertexUsed * sizeof(glm::vec3), capacity * sizeof(glm::vec3));
+            grow(attributeVBO, vertexUsed * layout.stride, capacity * layout.stride);
+            vertexCapacity = capacity;
+            changed = true;
+        }
+        if (indices > indexCapacity[pool])
+        {
+            size_t indexSize = pool == 0 ? sizeof(GLushort) : sizeof(GLuint);
+            size_t capacity = std::max(indices, indexCapacity[pool] * 2);
+            grow(EBO[pool], indexUsed[pool] * indexSize, capacity * indexSize);
+            indexCapacity[pool] = capacity;
+            changed = true;
+        }
+        if (changed)
+            setupVertexArrays();
+    }
+};
+
+// procedural primitives registered in an arena, every tessellation level generated on first use
+class GeometryLibrary
+{
+public:
+    static GeometryLibrary& Get()
+    {
+        static GeometryLibrary library;
+        return library;
+    }
+
+    GeometryArena arena;
+
+    const ArenaMesh& Mesh(Primitive primitive)
+    {
+        ArenaMesh& mesh = meshes[primitive];
+        if (mesh.lodCount == 0)
+        {
+            int levels = primitiveHasLods(primitive) ? GEOMETRY_LOD_COUNT : 1;
+            for (int lod = 0; lod < levels && lod < ARENA_MAX_LODS; ++lod)
+            {
+                GeometryData data = buildPrimitive(primitive, lod);
+                mesh.lods[lod] = arena.Add(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size());
+                mesh.lods[lod].error = data.error;
+                mesh.radius = std::max(mesh.radius, data.radius);
+            }
+            mesh.lodCount = std::min(levels, ARENA_MAX_LODS);
+        }
+        return mesh;
+    }
+
+private:
+    ArenaMesh meshes[PRIMITIVE_COUNT];
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad.c is generated for plain GL 3.3 core. Entry points from newer versions are looked up at
+// runtime here and stay null when the driver doesn't offer them, so every caller needs a 3.3 path.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+typedef void (APIENTRYP GLEXT_MULTIDRAWELEMENTSINDIRECT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP GLEXT_TEXSTORAGE2D)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+
+// layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+struct GLExtensions {
+    int major = 3;
+    int minor = 3;
+    GLEXT_MULTIDRAWELEMENTSINDIRECT MultiDrawElementsIndirect = nullptr;
+    GLEXT_TEXSTORAGE2D TexStorage2D = nullptr;
+
+    bool AtLeast(int wantMajor, int wantMinor) const
+    {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+    bool Supports(const char* extension) const
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && std::strcmp(name, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+inline GLExtensions& glext()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+// call once after gladLoadGLLoader with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions& ext = glext();
+    glGetIntegerv(GL_MAJOR_VERSION, &ext.major);
+    glGetIntegerv(GL_MINOR_VERSION, &ext.minor);
+    if (ext.AtLeast(4, 3) || ext.Supports("GL_ARB_multi_draw_indirect"))
+        ext.MultiDrawElementsIndirect = (GLEXT_MULTIDRAWELEMENTSINDIRECT)load("glMultiDrawElementsIndirect");
+    if (ext.AtLeast(4, 2) || ext.Supports("GL_ARB_texture_storage"))
+        ext.TexStorage2D = (GLEXT_TEXSTORAGE2D)load("glTexStorage2D");
+}
+
+#endif
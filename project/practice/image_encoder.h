@@ -0,0 +1,471 @@
+#ifndef IMAGE_ENCODER_H
+#define IMAGE_ENCODER_H
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Encoders the capture path can write a frame with. Which one pays off depends on what bounds a
+// run: JPEG is small but slow and lossy, PNG is lossless with its zlib level trading time for
+// size, QOI is lossless and several times faster than PNG at a somewhat larger size, and NPY
+// writes the frame as it is (uint8, or float16 in [0, 1]) for runs where only the disk is
+// limited. benchmarkEncoders measures all of them on a real frame.
+//
+// Every encoder takes tightly packed RGB rows bottom row first (as glReadPixels returns them) and
+// writes the image top row first.
+
+enum ImageFormat {
+    IMAGE_JPEG,
+    IMAGE_PNG,
+    IMAGE_QOI,
+    IMAGE_NPY_U8,
+    IMAGE_NPY_F16,
+    IMAGE_FORMAT_COUNT
+};
+
+struct EncoderSettings {
+    ImageFormat format = IMAGE_JPEG;
+    int jpegQuality = 100;  // 1..100
+    int jpegStripes = 1;    // >1: bands between restart markers, encoded in parallel on the shared pool (large captures)
+    int pngLevel = 8;       // zlib level, 0..9
+};
+
+inline const char* imageExtension(ImageFormat format)
+{
+    switch (format)
+    {
+    case IMAGE_PNG: return ".png";
+    case IMAGE_QOI: return ".qoi";
+    case IMAGE_NPY_U8:
+    case IMAGE_NPY_F16: return ".npy";
+    default: return ".jpg";
+    }
+}
+
+inline const char* imageFormatName(ImageFormat format)
+{
+    switch (format)
+    {
+    case IMAGE_PNG: return "png";
+    case IMAGE_QOI: return "qoi";
+    case IMAGE_NPY_U8: return "npy-u8";
+    case IMAGE_NPY_F16: return "npy-f16";
+    default: return "jpeg";
+    }
+}
+
+// QOI (the "Quite OK Image" format): run lengths, a 64 entry hash of recent colors and small
+// deltas to the previous pixel, one pass and no entropy coding
+// ----------------------------------------------------------------------------------------------
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+
+inline int qoiHash(const unsigned char* rgb)
+{
+    return (rgb[0] * 3 + rgb[1] * 5 + rgb[2] * 7 + 255 * 11) % 64;
+}
+
+inline void qoiWrite32(std::vector<unsigned char>& out, uint32_t value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+inline void encodeQoi(const unsigned char* pixels, int width, int height, std::vector<unsigned char>& out)
+{
+    out.clear();
+    // worst case is an RGB op for every pixel
+    out.reserve(QOI_HEADER_SIZE + (size_t)width * height * 4 + QOI_PADDING_SIZE);
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    qoiWrite32(out, (uint32_t)width);
+    qoiWrite32(out, (uint32_t)height);
+    out.push_back(3);   // channels
+    out.push_back(0);   // sRGB with linear alpha
+
+    // the fourth byte marks entries that hold a pixel (alpha 255) rather than the initial zeros
+    unsigned char index[64][4] = {};
+    unsigned char previous[3] = { 0, 0, 0 };
+    int run = 0;
+    for (int y = height - 1; y >= 0; --y)
+    {
+        const unsigned char* px = pixels + (size_t)y * width * 3;
+        for (int x = 0; x < width; ++x, px += 3)
+        {
+            if (px[0] == previous[0] && px[1] == previous[1] && px[2] == previous[2])
+            {
+                if (++run == 62)
+                {
+                    out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+            int hash = qoiHash(px);
+            if (index[hash][3] && index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2])
+                out.push_back((unsigned char)(QOI_OP_INDEX | hash));
+            else
+            {
+                std::memcpy(index[hash], px, 3);
+                index[hash][3] = 255;
+                // channel differences wrap around, as in the decoder
+                int dr = (signed char)(px[0] - previous[0]);
+                int dg = (signed char)(px[1] - previous[1]);
+                int db = (signed char)(px[2] - previous[2]);
+                int drg = dr - dg, dbg = db - dg;
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+                    out.push_back((unsigned char)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8)
+                {
+                    out.push_back((unsigned char)(QOI_OP_LUMA | (dg + 32)));
+                    out.push_back((unsigned char)((drg + 8) << 4 | (dbg + 8)));
+                }
+                else
+                    out.insert(out.end(), { (unsigned char)QOI_OP_RGB, px[0], px[1], px[2] });
+            }
+            std::memcpy(previous, px, 3);
+        }
+    }
+    if (run > 0)
+        out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+}
+
+// RGB rows top row first; false on anything but a 3 channel image of the expected size
+inline bool decodeQoi(const unsigned char* data, size_t size, int width, int height, std::vector<unsigned char>& rgb)
+{
+    if (size < QOI_HEADER_SIZE + QOI_PADDING_SIZE || std::memcmp(data, "qoif", 4) != 0)
+        return false;
+    uint32_t w = (uint32_t)data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+    uint32_t h = (uint32_t)data[8] << 24 | data[9] << 16 | data[10] << 8 | data[11];
+    if (w != (uint32_t)width || h != (uint32_t)height || data[12] != 3)
+        return false;
+
+    rgb.resize((size_t)width * height * 3);
+    unsigned char index[64][3] = {};
+    unsigned char px[3] = { 0, 0, 0 };
+    size_t p = QOI_HEADER_SIZE, end = size - QOI_PADDING_SIZE;
+    int run = 0;
+    for (size_t i = 0; i < rgb.size(); i += 3)
+    {
+        if (run > 0)
+            --run;
+        else if (p < end)
+        {
+            unsigned char op = data[p++];
+            if (op == QOI_OP_RGB)
+            {
+                if (p + 3 > end)
+                    return false;
+                std::memcpy(px, data + p, 3);
+                p += 3;
+            }
+            else if ((op & 0xc0) == QOI_OP_INDEX)
+                std::memcpy(px, index[op & 0x3f], 3);
+            else if ((op & 0xc0) == QOI_OP_DIFF)
+            {
+                px[0] += ((op >> 4) & 3) - 2;
+                px[1] += ((op >> 2) & 3) - 2;
+                px[2] += (op & 3) - 2;
+            }
+            else if ((op & 0xc0) == QOI_OP_LUMA)
+            {
+                if (p >= end)
+                    return false;
+                int dg = (op & 0x3f) - 32;
+                unsigned char next = data[p++];
+                px[0] += dg - 8 + ((next >> 4) & 0x0f);
+                px[1] += dg;
+                px[2] += dg - 8 + (next & 0x0f);
+            }
+            else if ((op & 0xc0) == QOI_OP_RUN)
+                run = op & 0x3f;
+            else
+                return false;   // RGBA ops don't occur in 3 channel images
+            std::memcpy(index[qoiHash(px)], px, 3);
+        }
+        std::memcpy(&rgb[i], px, 3);
+    }
+    return true;
+}
+
+// NPY (numpy's .npy): a short text header describing the array, then the raw (height, width, 3)
+// array in C order
+// ----------------------------------------------------------------------------------------------
+
+// IEEE half of a float, rounded to nearest even; values below the smallest normal half flush to
+// zero, which no channel value / 255 is
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    uint16_t half = (uint16_t)(sign | exponent << 10 | mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        ++half;     // a carry into the exponent is still the correctly rounded value
+    return half;
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    float value;
+    if (exponent == 0)
+        value = std::ldexp((float)mantissa, -24);
+    else if (exponent == 31)
+        value = mantissa ? NAN : INFINITY;
+    else
+        value = std::ldexp((float)(mantissa | 0x400), exponent - 25);
+    return (half & 0x8000) ? -value : value;
+}
+
+inline void npyHeader(const char* descr, int width, int height, std::vector<unsigned char>& out)
+{
+    char dictionary[128];
+    int length = std::snprintf(dictionary, sizeof(dictionary),
+        "{'descr': '%s', 'fortran_order': False, 'shape': (%d, %d, 3), }", descr, height, width);
+    // magic, version 1.0, header length, then the dictionary padded so the data starts 64 byte aligned
+    size_t total = (10 + length + 1 + 63) / 64 * 64;
+    uint16_t headerLength = (uint16_t)(total - 10);
+    out.clear();
+    out.insert(out.end(), { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0 });
+    out.push_back((unsigned char)(headerLength & 0xff));
+    out.push_back((unsigned char)(headerLength >> 8));
+    out.insert(out.end(), dictionary, dictionary + length);
+    out.resize(total - 1, ' ');
+    out.push_back('\n');
+}
+
+inline void encodeNpy(const unsigned char* pixels, int width, int height, bool float16, std::vector<unsigned char>& out)
+{
+    npyHeader(float16 ? "<f2" : "|u1", width, height, out);
+    size_t header = out.size(), rowBytes = (size_t)width * 3;
+    if (!float16)
+    {
+        out.resize(header + rowBytes * height);
+        for (int y = 0; y < height; ++y)
+            std::memcpy(&out[header + rowBytes * y], pixels + rowBytes * (height - 1 - y), rowBytes);
+        return;
+    }
+    static const std::vector<uint16_t> halves = [] {
+        std::vector<uint16_t> table(256);
+        for (int i = 0; i < 256; ++i)
+            table[i] = floatToHalf(i / 255.0f);
+        return table;
+    }();
+    out.resize(header + rowBytes * height * 2);
+    unsigned char* dst = &out[header];
+    for (int y = height - 1; y >= 0; --y)
+    {
+        const unsigned char* src = pixels + rowBytes * y;
+        for (size_t i = 0; i < rowBytes; ++i, dst += 2)
+        {
+            uint16_t half = halves[src[i]];
+            dst[0] = (unsigned char)(half & 0xff);  // little endian, as the header says
+            dst[1] = (unsigned char)(half >> 8);
+        }
+    }
+}
+
+inline bool decodeNpy(const unsigned char* data, size_t size, int width, int height, std::vector<unsigned char>& rgb)
+{
+    if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+        return false;
+    size_t header = 10 + (data[8] | data[9] << 8);
+    if (header > size)
+        return false;
+    std::string dictionary((const char*)data + 10, header - 10);
+    bool float16 = dictionary.find("'<f2'") != std::string::npos;
+    size_t count = (size_t)width * height * 3;
+    if (size - header != count * (float16 ? 2 : 1))
+        return false;
+    rgb.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!float16)
+        {
+            rgb[i] = data[header + i];
+            continue;
+        }
+        float value = halfToFloat((uint16_t)(data[header + i * 2] | data[header + i * 2 + 1] << 8));
+        rgb[i] = (unsigned char)std::min(255.0f, std::max(0.0f, std::floor(value * 255.0f + 0.5f)));
+    }
+    return true;
+}
+
+// stbi_write_parallel_func on the shared pool
+inline void parallelStripes(void*, int count, void (*job)(void* jobContext, int index), void* jobContext)
+{
+    ThreadPool::Shared().ParallelFor((size_t)count, [&](size_t i) { job(jobContext, (int)i); });
+}
+
+// the capture path's entry point
+// ------------------------------
+inline bool encodeImage(const EncoderSettings& settings, const unsigned char* pixels, int width, int height, std::vector<unsigned char>& out)
+{
+    out.clear();
+    auto append = [](void* context, void* data, int size) {
+        std::vector<unsigned char>* bytes = static_cast<std::vector<unsigned char>*>(context);
+        bytes->insert(bytes->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+    };
+    switch (settings.format)
+    {
+    case IMAGE_PNG:
+        stbi_flip_vertically_on_write(1);
+        stbi_write_png_compression_level = settings.pngLevel;
+        return stbi_write_png_to_func(append, &out, width, height, 3, pixels, width * 3) != 0;
+    case IMAGE_QOI:
+        encodeQoi(pixels, width, height, out);
+        return true;
+    case IMAGE_NPY_U8:
+    case IMAGE_NPY_F16:
+        encodeNpy(pixels, width, height, settings.format == IMAGE_NPY_F16, out);
+        return true;
+    default:
+        stbi_flip_vertically_on_write(1); // Flip the image vertically (OpenGL's origin is bottom-left)
+        if (settings.jpegStripes > 1)
+            return stbi_write_jpg_striped_to_func(append, &out, width, height, 3, pixels, settings.jpegQuality,
+                settings.jpegStripes, parallelStripes, nullptr) != 0;
+        return stbi_write_jpg_to_func(append, &out, width, height, 3, pixels, settings.jpegQuality) != 0;
+    }
+}
+
+// RGB rows top row first, for checking what an encoder kept
+inline bool decodeImage(ImageFormat format, const unsigned char* data, size_t size, int width, int height, std::vector<unsigned char>& rgb)
+{
+    switch (format)
+    {
+    case IMAGE_QOI:
+        return decodeQoi(data, size, width, height, rgb);
+    case IMAGE_NPY_U8:
+    case IMAGE_NPY_F16:
+        return decodeNpy(data, size, width, height, rgb);
+    default:
+    {
+        int w, h, channels;
+        unsigned char* decoded = stbi_load_from_memory(data, (int)size, &w, &h, &channels, 3);
+        if (!decoded)
+            return false;
+        bool matches = w == width && h == height;
+        if (matches)
+            rgb.assign(decoded, decoded + (size_t)w * h * 3);
+        stbi_image_free(decoded);
+        return matches;
+    }
+    }
+}
+
+// Encodes a frame with every encoder (JPEG at two qualities and striped over the pool, PNG at
+// four zlib levels, QOI, both NPY types) and prints throughput over the raw frame size, file size and the error of the
+// decoded result against the frame
+inline void benchmarkEncoders(const unsigned char* pixels, int width, int height)
+{
+    EncoderSettings configurations[10];
+    configurations[0].format = IMAGE_JPEG;
+    configurations[1].format = IMAGE_JPEG;
+    configurations[1].jpegQuality = 90;
+    configurations[2].format = IMAGE_JPEG;
+    configurations[2].jpegStripes = 4 * (int)(ThreadPool::Shared().Size() + 1);
+    configurations[3].format = IMAGE_PNG;
+    configurations[3].pngLevel = 1;
+    configurations[4].format = IMAGE_PNG;
+    configurations[4].pngLevel = 5;
+    configurations[5].format = IMAGE_PNG;
+    configurations[5].pngLevel = 8;
+    configurations[6].format = IMAGE_PNG;
+    configurations[6].pngLevel = 9;
+    configurations[7].format = IMAGE_QOI;
+    configurations[8].format = IMAGE_NPY_U8;
+    configurations[9].format = IMAGE_NPY_F16;
+
+    size_t rawBytes = (size_t)width * height * 3;
+    std::cout << "encoder benchmark, " << width << "x" << height << " RGB (" << rawBytes / 1024 << " KiB raw)" << std::endl;
+    std::cout << "  encoder        MB/s      KiB    ratio   max err  PSNR dB" << std::endl;
+    int savedPngLevel = stbi_write_png_compression_level;
+    std::vector<unsigned char> encoded, decoded;
+    for (const EncoderSettings& settings : configurations)
+    {
+        // best of a few runs, at least three and about a quarter second
+        double best = 1e30, spent = 0.0;
+        for (int run = 0; run < 3 || (spent < 250.0 && run < 100); ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            encodeImage(settings, pixels, width, height, encoded);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, ms);
+            spent += ms;
+        }
+
+        int maxError = -1;
+        double squared = 0.0;
+        if (decodeImage(settings.format, encoded.data(), encoded.size(), width, height, decoded))
+        {
+            maxError = 0;
+            for (int y = 0; y < height; ++y)
+            {
+                const unsigned char* frame = pixels + (size_t)(height - 1 - y) * width * 3;
+                const unsigned char* result = &decoded[(size_t)y * width * 3];
+                for (int i = 0; i < width * 3; ++i)
+                {
+                    int d = std::abs(frame[i] - result[i]);
+                    maxError = std::max(maxError, d);
+                    squared += (double)d * d;
+                }
+            }
+        }
+
+        char name[32];
+        if (settings.format == IMAGE_JPEG && settings.jpegStripes > 1)
+            std::snprintf(name, sizeof(name), "jpeg q%d /%d", settings.jpegQuality, settings.jpegStripes);
+        else if (settings.format == IMAGE_JPEG)
+            std::snprintf(name, sizeof(name), "jpeg q%d", settings.jpegQuality);
+        else if (settings.format == IMAGE_PNG)
+            std::snprintf(name, sizeof(name), "png z%d", settings.pngLevel);
+        else
+            std::snprintf(name, sizeof(name), "%s", imageFormatName(settings.format));
+        char line[128];
+        if (maxError < 0)
+            std::snprintf(line, sizeof(line), "  %-12s %7.1f %8.1f %7.2f   (decode failed)",
+                name, rawBytes / (best * 1000.0), encoded.size() / 1024.0, (double)rawBytes / encoded.size());
+        else if (squared == 0.0)
+            std::snprintf(line, sizeof(line), "  %-12s %7.1f %8.1f %7.2f %8d      inf",
+                name, rawBytes / (best * 1000.0), encoded.size() / 1024.0, (double)rawBytes / encoded.size(), maxError);
+        else
+            std::snprintf(line, sizeof(line), "  %-12s %7.1f %8.1f %7.2f %8d %8.2f",
+                name, rawBytes / (best * 1000.0), encoded.size() / 1024.0, (double)rawBytes / encoded.size(), maxError,
+                10.0 * std::log10(255.0 * 255.0 * rawBytes / squared));
+        std::cout << line << std::endl;
+    }
+    stbi_write_png_compression_level = savedPngLevel;
+}
+
+#endif
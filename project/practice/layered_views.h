@@ -0,0 +1,129 @@
+#ifndef LAYERED_VIEWS_H
+#define LAYERED_VIEWS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <vector>
+
+// Render target for drawing up to LAYERED_MAX_VIEWS cameras in one submission: the views'
+// matrices and eye positions sit in a uniform block, every draw is instanced once per view
+// (SceneDrawList::DrawViews) and the geometry shader sends instance i to layer i of a 2D texture
+// array. All layers come back with a single readback.
+
+#define LAYERED_MAX_VIEWS 16        // MAX_VIEWS in 3.2.1.point_shadows_layered.gs
+#define LAYERED_VIEWS_BINDING 0     // uniform buffer binding point of the Views block
+
+class LayeredViewTarget
+{
+public:
+    LayeredViewTarget() {}
+    LayeredViewTarget(const LayeredViewTarget&) = delete;
+    LayeredViewTarget& operator=(const LayeredViewTarget&) = delete;
+
+    ~LayeredViewTarget()
+    {
+        if (framebuffer)
+        {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &colorArray);
+            glDeleteTextures(1, &depthArray);
+            glDeleteBuffers(1, &viewBuffer);
+        }
+    }
+
+    // points a program's Views block at the buffer SetViews fills
+    static void BindProgram(unsigned int program)
+    {
+        unsigned int block = glGetUniformBlockIndex(program, "Views");
+        if (block == GL_INVALID_INDEX)
+        {
+            std::cout << "ERROR::LAYERED_VIEWS::NO_VIEWS_BLOCK" << std::endl;
+            return;
+        }
+        glUniformBlockBinding(program, block, LAYERED_VIEWS_BINDING);
+    }
+
+    // (re)allocates the texture arrays when the size or layer count changes
+    void Resize(int newWidth, int newHeight, int newLayers)
+    {
+        if (framebuffer == 0)
+        {
+            glGenFramebuffers(1, &framebuffer);
+            glGenTextures(1, &colorArray);
+            glGenTextures(1, &depthArray);
+            glGenBuffers(1, &viewBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, viewBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewBlock), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        if (newWidth == width && newHeight == height && newLayers == layers)
+            return;
+        width = newWidth;
+        height = newHeight;
+        layers = newLayers;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, colorArray);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // attached whole, so gl_Layer picks the layer
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorArray, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::LAYERED_VIEWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // view projection matrices and eye positions of the first count layers
+    void SetViews(const glm::mat4* viewProjections, const glm::vec3* positions, unsigned int count)
+    {
+        ViewBlock block;
+        for (unsigned int v = 0; v < count && v < LAYERED_MAX_VIEWS; ++v)
+        {
+            block.viewProjection[v] = viewProjections[v];
+            block.viewPosition[v] = glm::vec4(positions[v], 1.0f);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, viewBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ViewBlock), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, LAYERED_VIEWS_BINDING, viewBuffer);
+    }
+
+    unsigned int Framebuffer() const { return framebuffer; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int Layers() const { return layers; }
+
+    // every layer as tightly packed RGB rows, bottom row first, layer after layer
+    void ReadBack(std::vector<unsigned char>& pixels)
+    {
+        pixels.resize((size_t)width * height * 3 * layers);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, colorArray);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+
+private:
+    // std140 layout of the Views block
+    struct ViewBlock {
+        glm::mat4 viewProjection[LAYERED_MAX_VIEWS];
+        glm::vec4 viewPosition[LAYERED_MAX_VIEWS];
+    };
+
+    unsigned int framebuffer = 0, colorArray = 0, depthArray = 0, viewBuffer = 0;
+    int width = 0, height = 0, layers = 0;
+};
+
+#endif
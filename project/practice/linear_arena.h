@@ -0,0 +1,127 @@
+#ifndef LINEAR_ARENA_H
+#define LINEAR_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for short lived staging memory (vertex streams and index copies on their way to
+// GL). Allocations are only freed all together by rewinding to a mark, so a whole model import
+// reuses the same few blocks instead of allocating and freeing per mesh and stream. Memory is
+// uninitialized and only suitable for trivially copyable types.
+
+#define LINEAR_ARENA_BLOCK_BYTES (4 * 1024 * 1024)
+#define LINEAR_ARENA_ALIGNMENT 16
+
+class LinearArena
+{
+public:
+    struct Mark {
+        size_t block, offset;
+    };
+
+    explicit LinearArena(size_t blockBytes = LINEAR_ARENA_BLOCK_BYTES) : blockBytes(blockBytes) {}
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    // staging arena of the calling thread
+    static LinearArena& Staging()
+    {
+        static thread_local LinearArena arena;
+        return arena;
+    }
+
+    template <class T>
+    T* Allocate(size_t count)
+    {
+        return (T*)allocate(std::max<size_t>(count * sizeof(T), 1));
+    }
+
+    Mark Position() const { return Mark{ current, offset }; }
+
+    // frees everything allocated after mark. Rewinding to the very start folds the blocks into a
+    // single one big enough for the high water mark, so the next round needs no new blocks.
+    void Rewind(const Mark& mark)
+    {
+        current = mark.block;
+        offset = mark.offset;
+        if (current == 0 && offset == 0 && blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const Block& block : blocks)
+                total += block.size;
+            blocks.clear();
+            addBlock(total);
+        }
+    }
+
+    size_t Used() const
+    {
+        size_t used = offset;
+        for (size_t b = 0; b < current && b < blocks.size(); ++b)
+            used += blocks[b].size;
+        return used;
+    }
+    size_t Capacity() const
+    {
+        size_t total = 0;
+        for (const Block& block : blocks)
+            total += block.size;
+        return total;
+    }
+    size_t Peak() const { return peak; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t blockBytes;
+    size_t current = 0, offset = 0;     // block being bumped and the offset in it
+    size_t peak = 0;
+
+    void addBlock(size_t bytes)
+    {
+        Block block;
+        block.size = std::max(bytes, blockBytes);
+        block.memory.reset(new unsigned char[block.size + LINEAR_ARENA_ALIGNMENT]);
+        blocks.push_back(std::move(block));
+    }
+
+    unsigned char* allocate(size_t bytes)
+    {
+        bytes = (bytes + LINEAR_ARENA_ALIGNMENT - 1) & ~(size_t)(LINEAR_ARENA_ALIGNMENT - 1);
+        while (current < blocks.size() && offset + bytes > blocks[current].size)
+        {
+            ++current;
+            offset = 0;
+        }
+        if (current == blocks.size())
+            addBlock(bytes);
+        unsigned char* base = blocks[current].memory.get();
+        base += (LINEAR_ARENA_ALIGNMENT - (size_t)base % LINEAR_ARENA_ALIGNMENT) % LINEAR_ARENA_ALIGNMENT;
+        unsigned char* result = base + offset;
+        offset += bytes;
+        peak = std::max(peak, Used());
+        return result;
+    }
+};
+
+// rewinds the arena to where it was when the scope was entered
+class LinearArenaScope
+{
+public:
+    explicit LinearArenaScope(LinearArena& arena) : arena(arena), mark(arena.Position()) {}
+    ~LinearArenaScope() { arena.Rewind(mark); }
+    LinearArenaScope(const LinearArenaScope&) = delete;
+    LinearArenaScope& operator=(const LinearArenaScope&) = delete;
+
+private:
+    LinearArena& arena;
+    LinearArena::Mark mark;
+};
+
+#endif
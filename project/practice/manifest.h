@@ -0,0 +1,280 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <glm/glm.hpp>
+
+#include "offscreen_target.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Append-only record of a generation run, one JSON object per line and per finished sample. A
+// line is only written after the sample's image is in place, and a torn last line (the process
+// died while writing it) is skipped on load, so after a crash the run resumes from the first id
+// the manifest doesn't have and nothing listed is missing. Lines are flushed as they are written
+// and synced to disk every MANIFEST_SYNC_INTERVAL samples, which bounds what a lost machine redoes.
+
+#define MANIFEST_SYNC_INTERVAL 64
+
+// how much of a capture the shadows change: mean luma of each pass, and the share of pixels where
+// the hard and the soft shadow image disagree (penumbrae and shadow edges)
+struct ShadowStats {
+    float meanLuma[2] = { 0.0f, 0.0f };     // hard shadow pass, pcss pass (0 when not captured)
+    float penumbraCoverage = 0.0f;          // needs both passes in the capture
+};
+
+// RGB rows, bottom row first, with the passes where layout puts them
+inline ShadowStats shadowStats(const unsigned char* pixels, int width, int height, CaptureLayout layout)
+{
+    ShadowStats stats;
+    PassViewport passes[2];
+    captureViewports(layout, width, height, passes);
+    for (int p = 0; p < 2; ++p)
+    {
+        if (passes[p].width == 0)
+            continue;
+        uint64_t sum = 0;
+        for (int y = 0; y < passes[p].height; ++y)
+        {
+            const unsigned char* row = pixels + ((size_t)(passes[p].y + y) * width + passes[p].x) * 3;
+            for (int x = 0; x < passes[p].width; ++x)
+                sum += (row[x * 3] * 54u + row[x * 3 + 1] * 183u + row[x * 3 + 2] * 19u) >> 8;
+        }
+        stats.meanLuma[p] = (float)sum / (255.0f * passes[p].width * passes[p].height);
+    }
+    if (passes[0].width > 0 && passes[1].width > 0)
+    {
+        const int threshold = 8;
+        uint64_t differing = 0;
+        for (int y = 0; y < passes[0].height; ++y)
+        {
+            const unsigned char* hard = pixels + ((size_t)(passes[0].y + y) * width + passes[0].x) * 3;
+            const unsigned char* soft = pixels + ((size_t)(passes[1].y + y) * width + passes[1].x) * 3;
+            for (int x = 0; x < passes[0].width * 3; x += 3)
+            {
+                int d = std::abs(hard[x] - soft[x]) + std::abs(hard[x + 1] - soft[x + 1]) + std::abs(hard[x + 2] - soft[x + 2]);
+                differing += d > threshold ? 1 : 0;
+            }
+        }
+        stats.penumbraCoverage = (float)differing / ((float)passes[0].width * passes[0].height);
+    }
+    return stats;
+}
+
+// id of a finished record line; false for torn or foreign lines
+inline bool manifestRecordId(const std::string& line, uint64_t& id)
+{
+    // a finished record is a whole object
+    if (line.empty() || line[0] != '{' || line[line.size() - 1] != '}')
+        return false;
+    const char* field = std::strstr(line.c_str(), "\"id\":");
+    if (!field)
+        return false;
+    id = std::strtoull(field + 5, nullptr, 10);
+    return true;
+}
+
+// calls visit(id, line) for every finished record of a manifest; false when it can't be read
+template <typename Visit>
+bool readManifest(const std::string& path, Visit visit)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    std::string line;
+    char buffer[4096];
+    size_t read;
+    uint64_t id;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        for (size_t i = 0; i < read; ++i)
+        {
+            if (buffer[i] != '\n')
+            {
+                line += buffer[i];
+                continue;
+            }
+            if (manifestRecordId(line, id))
+                visit(id, line);
+            line.clear();
+        }
+    // whatever is left has no newline: a record that never finished
+    std::fclose(file);
+    return true;
+}
+
+// number of finished records, 0 when the manifest doesn't exist yet
+inline size_t countManifestRecords(const std::string& path)
+{
+    size_t count = 0;
+    readManifest(path, [&](uint64_t, const std::string&) { ++count; });
+    return count;
+}
+
+// Merges the records of several manifests (and whatever output already holds) into one index
+// sorted by id, replacing output only once it is complete. Ids listed twice keep the first line.
+inline bool mergeManifests(const std::vector<std::string>& inputs, const std::string& output)
+{
+    std::map<uint64_t, std::string> records;
+    auto add = [&](uint64_t id, const std::string& line) { records.emplace(id, line); };
+    readManifest(output, add);
+    for (const std::string& input : inputs)
+        if (!readManifest(input, add))
+            std::cout << "ERROR::MANIFEST::MISSING_SHARD " << input << std::endl;
+
+    std::string temporary = output + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file)
+    {
+        std::cout << "ERROR::MANIFEST::OPEN_FAILED " << temporary << std::endl;
+        return false;
+    }
+    for (const auto& record : records)
+    {
+        std::fputs(record.second.c_str(), file);
+        std::fputc('\n', file);
+    }
+    bool written = std::fflush(file) == 0;
+    std::fclose(file);
+    std::remove(output.c_str());
+    if (!written || std::rename(temporary.c_str(), output.c_str()) != 0)
+    {
+        std::cout << "ERROR::MANIFEST::MERGE_FAILED " << output << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// one finished sample
+struct SampleRecord {
+    uint64_t id = 0;
+    uint64_t seed = 0, sample = 0;  // procedural scenes
+    int scene = 0, light = 0, view = 0;
+    glm::vec3 lightPos = glm::vec3(0.0f), cameraPos = glm::vec3(0.0f), cameraFront = glm::vec3(0.0f);
+    std::string file;
+    int width = 0, height = 0;
+    size_t bytes = 0;
+    double renderMs = 0.0, readbackMs = 0.0, encodeMs = 0.0, writeMs = 0.0;
+    ShadowStats shadows;
+};
+
+class SampleManifest
+{
+public:
+    SampleManifest() {}
+    SampleManifest(const SampleManifest&) = delete;
+    SampleManifest& operator=(const SampleManifest&) = delete;
+    ~SampleManifest() { Close(); }
+
+    // loads the ids an earlier run finished and opens the file for appending
+    bool Open(const std::string& path)
+    {
+        Close();
+        completed.clear();
+        readManifest(path, [this](uint64_t id, const std::string&) { completed.insert(id); });
+        bool endsWithNewline = true;
+        if (FILE* existing = std::fopen(path.c_str(), "rb"))
+        {
+            // a last record that never finished has no newline
+            if (std::fseek(existing, -1, SEEK_END) == 0)
+                endsWithNewline = std::fgetc(existing) == '\n';
+            std::fclose(existing);
+        }
+        file = std::fopen(path.c_str(), "ab");
+        if (!file)
+        {
+            std::cout << "ERROR::MANIFEST::OPEN_FAILED " << path << std::endl;
+            return false;
+        }
+        // keep the torn line apart from the records that follow
+        if (!endsWithNewline)
+            std::fputc('\n', file);
+        return true;
+    }
+
+    void Close()
+    {
+        if (!file)
+            return;
+        sync();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    bool Contains(uint64_t id) const { return completed.count(id) != 0; }
+    size_t Count() const { return completed.size(); }
+
+    uint64_t FirstMissing(uint64_t from = 0) const
+    {
+        uint64_t id = from;
+        while (completed.count(id))
+            ++id;
+        return id;
+    }
+
+    void Append(const SampleRecord& record)
+    {
+        completed.insert(record.id);
+        if (!file)
+            return;
+        std::fprintf(file,
+            "{\"id\":%llu,\"seed\":%llu,\"sample\":%llu,\"scene\":%d,\"light\":%d,\"view\":%d,"
+            "\"light_pos\":[%.4f,%.4f,%.4f],\"camera_pos\":[%.4f,%.4f,%.4f],\"camera_front\":[%.4f,%.4f,%.4f],"
+            "\"file\":\"%s\",\"width\":%d,\"height\":%d,\"bytes\":%llu,"
+            "\"render_ms\":%.3f,\"readback_ms\":%.3f,\"encode_ms\":%.3f,\"write_ms\":%.3f,"
+            "\"mean_luma_hard\":%.4f,\"mean_luma_pcss\":%.4f,\"penumbra_coverage\":%.4f}\n",
+            (unsigned long long)record.id, (unsigned long long)record.seed, (unsigned long long)record.sample,
+            record.scene, record.light, record.view,
+            record.lightPos.x, record.lightPos.y, record.lightPos.z,
+            record.cameraPos.x, record.cameraPos.y, record.cameraPos.z,
+            record.cameraFront.x, record.cameraFront.y, record.cameraFront.z,
+            escape(record.file).c_str(), record.width, record.height, (unsigned long long)record.bytes,
+            record.renderMs, record.readbackMs, record.encodeMs, record.writeMs,
+            record.shadows.meanLuma[0], record.shadows.meanLuma[1], record.shadows.penumbraCoverage);
+        std::fflush(file);
+        if (++unsynced >= MANIFEST_SYNC_INTERVAL)
+            sync();
+    }
+
+private:
+    FILE* file = nullptr;
+    std::unordered_set<uint64_t> completed;
+    unsigned int unsynced = 0;
+
+    void sync()
+    {
+        std::fflush(file);
+#ifdef _WIN32
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+        unsynced = 0;
+    }
+
+    static std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+#endif
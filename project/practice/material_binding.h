@@ -0,0 +1,82 @@
+#ifndef MATERIAL_BINDING_H
+#define MATERIAL_BINDING_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Texture bindings of a mesh resolved once per (mesh, shader) instead of on every draw. Each
+// sampler name ("texture_diffuse1", ...) gets a fixed texture unit per program the first time it
+// is seen, and the sampler uniform is set then, so a draw is only the glBindTexture calls.
+
+#define MATERIAL_MAX_TEXTURE_UNITS 16
+
+struct MaterialBinding {
+    unsigned int unit;
+    unsigned int texture;
+};
+
+// what a mesh binds for one shader program
+struct MaterialBindingTable {
+    unsigned int program = 0;
+    std::vector<MaterialBinding> bindings;
+};
+
+// the unit of a sampler in a program, assigning (and setting the uniform of) new ones in order.
+// -1 if the program has no such sampler. The program has to be in use.
+inline int materialSamplerUnit(unsigned int program, const std::string& name)
+{
+    struct ProgramSamplers {
+        std::unordered_map<std::string, int> units;
+        int next = 0;
+    };
+    static std::unordered_map<unsigned int, ProgramSamplers> programs;
+
+    ProgramSamplers& samplers = programs[program];
+    auto found = samplers.units.find(name);
+    if (found != samplers.units.end())
+        return found->second;
+
+    int unit = -1;
+    GLint location = glGetUniformLocation(program, name.c_str());
+    if (location >= 0 && samplers.next < MATERIAL_MAX_TEXTURE_UNITS)
+    {
+        unit = samplers.next++;
+        glUniform1i(location, unit);
+    }
+    samplers.units[name] = unit;
+    return unit;
+}
+
+// textures bound per unit across the meshes of one draw call sequence, so binds that repeat the
+// previous mesh's are skipped. Only valid while nothing else binds textures in between.
+struct TextureBindState {
+    unsigned int bound[MATERIAL_MAX_TEXTURE_UNITS];
+    int activeUnit;
+
+    TextureBindState() { Reset(); }
+
+    void Reset()
+    {
+        for (unsigned int& texture : bound)
+            texture = ~0u;
+        activeUnit = -1;
+    }
+
+    void Bind(unsigned int unit, unsigned int texture)
+    {
+        if (bound[unit] == texture)
+            return;
+        if (activeUnit != (int)unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = (int)unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        bound[unit] = texture;
+    }
+};
+
+#endif
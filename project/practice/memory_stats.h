@@ -0,0 +1,56 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cstdio>
+#include <cstring>
+#endif
+
+#include <cstddef>
+
+// Resident and peak resident memory of the process, for the load time reports. Zero where the
+// platform doesn't tell.
+
+struct ProcessMemory {
+    size_t resident = 0;
+    size_t peak = 0;
+};
+
+inline ProcessMemory processMemory()
+{
+    ProcessMemory memory;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        memory.resident = counters.WorkingSetSize;
+        memory.peak = counters.PeakWorkingSetSize;
+    }
+#else
+    if (FILE* status = std::fopen("/proc/self/status", "r"))
+    {
+        char line[256];
+        while (std::fgets(line, sizeof(line), status))
+        {
+            unsigned long kilobytes = 0;
+            if (std::sscanf(line, "VmRSS: %lu kB", &kilobytes) == 1)
+                memory.resident = (size_t)kilobytes * 1024;
+            else if (std::sscanf(line, "VmHWM: %lu kB", &kilobytes) == 1)
+                memory.peak = (size_t)kilobytes * 1024;
+        }
+        std::fclose(status);
+    }
+#endif
+    return memory;
+}
+
+#endif
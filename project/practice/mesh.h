@@ -7,6 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader_s.h"
+#include "geometry_arena.h"
+#include "linear_arena.h"
+#include "material_binding.h"
+#include "mesh_simplify.h"
+#include "vertex_format.h"
 
 #include <string>
 #include <vector>
@@ -43,104 +48,280 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    vector<MeshLod>      lods;      // simplified index buffers, finest first (drawn by arena meshes)
+    unsigned int indexCount;        // of the full level; stays valid after ReleaseCpuData
     unsigned int VAO;
+    unsigned int DepthVAO;  // positions only, for depth passes
+    unsigned int format;    // VertexFormatFlags the GPU copy was built with
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);    // object space, filled in by the loader
+    // range in the shared arena when the mesh was sub-allocated from one (VAO is then the arena's)
+    GeometryArena* arena;
+    ArenaMesh      arenaMesh;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; with an arena the mesh is stored in the arena's buffers in its shared vertex
+    // format (position, normal, texture coords) instead of owning a VAO/VBO/EBO of its own.
+    // packing selects VERTEX_PACKED_NORMALS / VERTEX_HALF_TEXCOORDS; bone data and 16 bit
+    // indices are added when the mesh needs / allows them. lods are coarser index buffers over the
+    // same vertices (see buildLodChain); an arena mesh makes them its levels of detail. The
+    // buffers are taken over, pass them with std::move to avoid a copy.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GeometryArena* arena = nullptr,
+         unsigned int packing = VERTEX_FORMAT_COMPACT, vector<MeshLod> lods = vector<MeshLod>())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->lods = std::move(lods);
+        this->arena = arena;
+        this->indexCount = (unsigned int)this->indices.size();
+        this->format = packing & (VERTEX_PACKED_NORMALS | VERTEX_HALF_TEXCOORDS);
+        if (isSkinned())
+            this->format |= VERTEX_SKINNED;
+        if (this->vertices.size() <= 65536)
+            this->format |= VERTEX_SHORT_INDICES;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (arena)
+            setupArenaMesh();
+        else
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // render the mesh; the shader has to be in use. bindState carries the bound textures over
+    // from the previous mesh (see Model::Draw) so unchanged ones aren't bound again.
+    void Draw(Shader& shader, TextureBindState* bindState = nullptr)
     {
         // bind appropriate textures
+        TextureBindState local;
+        TextureBindState& state = bindState ? *bindState : local;
+        const MaterialBindingTable& table = materialBindings(shader.ID);
+        for (unsigned int i = 0; i < table.bindings.size(); i++)
+            state.Bind(table.bindings[i].unit, table.bindings[i].texture);
+
+        // draw mesh
+        drawElements(ARENA_STREAMS_ALL);
+
+        // always good practice to set everything back to defaults once configured.
+        if (!bindState)
+            glActiveTexture(GL_TEXTURE0);
+    }
+
+    // frees the CPU copies of the vertex and index data once the GPU has them; the mesh still
+    // draws, but can't be re-cooked or re-uploaded afterwards
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        vector<MeshLod>().swap(lods);
+    }
+
+    // bytes held by the CPU copies
+    size_t CpuBytes() const
+    {
+        size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+        for (const MeshLod& lod : lods)
+            bytes += lod.indices.capacity() * sizeof(unsigned int);
+        return bytes;
+    }
+
+    // call after changing textures so the binding tables are resolved again
+    void InvalidateMaterialBindings()
+    {
+        materialTables.clear();
+    }
+
+    // render the mesh for a depth-only pass: fetches nothing but the position stream
+    void DrawDepth()
+    {
+        drawElements(ARENA_STREAMS_POSITION);
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;      // VBO holds the position stream
+    unsigned int attributeVBO, skinVBO;
+    // one per shader program the mesh has been drawn with, usually one or two
+    vector<MaterialBindingTable> materialTables;
+
+    // texture units of this mesh's textures in a program, resolved on the first draw with it
+    const MaterialBindingTable& materialBindings(unsigned int program)
+    {
+        for (unsigned int i = 0; i < materialTables.size(); i++)
+            if (materialTables[i].program == program)
+                return materialTables[i];
+
+        MaterialBindingTable table;
+        table.program = program;
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if (name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
+                number = std::to_string(specularNr++);
             else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
+                number = std::to_string(normalNr++);
             else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
+                number = std::to_string(heightNr++);
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            int unit = materialSamplerUnit(program, name + number);
+            if (unit >= 0)
+                table.bindings.push_back(MaterialBinding{ (unsigned int)unit, textures[i].id });
         }
+        materialTables.push_back(table);
+        return materialTables.back();
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    bool isSkinned() const
+    {
+        for (const Vertex& v : vertices)
+            for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
+                if (v.m_Weights[i] > 0.0f)
+                    return true;
+        return false;
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    void drawElements(ArenaStreams streams)
+    {
+        if (arena)
+        {
+            const ArenaLod& lod = arenaMesh.lods[0];
+            size_t indexSize = lod.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+            glBindVertexArray(arena->VertexArray(streams, lod.indexType));
+            glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, lod.indexType, (void*)(lod.firstIndex * indexSize), lod.baseVertex);
+        }
+        else
+        {
+            GLenum indexType = (format & VERTEX_SHORT_INDICES) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            glBindVertexArray(streams == ARENA_STREAMS_ALL ? VAO : DepthVAO);
+            glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+        }
+        glBindVertexArray(0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
+    // copies the shared attributes into the arena; tangents and bone data are dropped
+    void setupArenaMesh()
+    {
+        LinearArenaScope scope(LinearArena::Staging());
+        GeometryVertex* shared = LinearArena::Staging().Allocate<GeometryVertex>(vertices.size());
+        glm::vec3 lo(0.0f), hi(0.0f);
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            shared[i].Position = vertices[i].Position;
+            shared[i].Normal = vertices[i].Normal;
+            shared[i].TexCoords = vertices[i].TexCoords;
+            lo = i ? glm::min(lo, vertices[i].Position) : vertices[i].Position;
+            hi = i ? glm::max(hi, vertices[i].Position) : vertices[i].Position;
+        }
+        // sphere around the box center, so submeshes away from the model origin stay tight
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (size_t i = 0; i < vertices.size(); ++i)
+            radius = std::max(radius, glm::length(vertices[i].Position - center));
+        arenaMesh.lods[0] = arena->Add(shared, vertices.size(), indices.data(), indices.size());
+        arenaMesh.lodCount = 1;
+        for (size_t i = 0; i < lods.size() && arenaMesh.lodCount < ARENA_MAX_LODS; ++i)
+        {
+            ArenaLod& lod = arenaMesh.lods[arenaMesh.lodCount++];
+            lod = arena->AddIndices(arenaMesh.lods[0], lods[i].indices.data(), lods[i].indices.size());
+            lod.error = lods[i].error;
+        }
+        arenaMesh.center = center;
+        arenaMesh.radius = radius;
+        VAO = arena->VertexArray(ARENA_STREAMS_ALL, arenaMesh.lods[0].indexType);
+        DepthVAO = arena->VertexArray(ARENA_STREAMS_POSITION, arenaMesh.lods[0].indexType);
+        VBO = EBO = attributeVBO = skinVBO = 0;
+    }
 
-    // initializes all the buffer objects/arrays
+    // initializes all the buffer objects/arrays. Positions get a tightly packed stream of their own
+    // (the only one the depth vertex array fetches); normal, texture coords and tangent go into a
+    // second stream encoded per format, bone data into a third one for skinned meshes only.
     void setupMesh()
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &DepthVAO);
         glGenBuffers(1, &VBO);
+        glGenBuffers(1, &attributeVBO);
         glGenBuffers(1, &EBO);
+        skinVBO = 0;
+
+        // encode the streams
+        LinearArenaScope scope(LinearArena::Staging());
+        VertexStreamLayout layout = vertexStreamLayout(format, true);
+        glm::vec3* positions = LinearArena::Staging().Allocate<glm::vec3>(vertices.size());
+        unsigned char* attributes = LinearArena::Staging().Allocate<unsigned char>(vertices.size() * layout.stride);
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const Vertex& v = vertices[i];
+            positions[i] = v.Position;
+            // the bitangent is rebuilt in the shader as cross(normal, tangent.xyz) * tangent.w
+            float handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            writeVertexAttributes(&attributes[i * layout.stride], layout, format, v.Normal, v.TexCoords, glm::vec4(v.Tangent, handedness));
+        }
 
-        glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), positions, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * layout.stride, attributes, GL_STATIC_DRAW);
 
+        glBindVertexArray(VAO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        if (format & VERTEX_SHORT_INDICES)
+        {
+            GLushort* shortIndices = LinearArena::Staging().Allocate<GLushort>(indices.size());
+            std::copy(indices.begin(), indices.end(), shortIndices);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), shortIndices, GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        // vertex normals, texture coords and tangent
+        glBindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+        setVertexAttributePointers(layout, format);
+        if (format & VERTEX_SKINNED)
+        {
+            struct SkinVertex {
+                GLushort ids[MAX_BONE_INFLUENCE];
+                GLubyte  weights[MAX_BONE_INFLUENCE];
+            };
+            SkinVertex* skin = LinearArena::Staging().Allocate<SkinVertex>(vertices.size());
+            for (size_t i = 0; i < vertices.size(); ++i)
+                for (int j = 0; j < MAX_BONE_INFLUENCE; ++j)
+                {
+                    skin[i].ids[j] = (GLushort)std::max(vertices[i].m_BoneIDs[j], 0);
+                    skin[i].weights[j] = (GLubyte)std::lround(std::max(0.0f, std::min(1.0f, vertices[i].m_Weights[j])) * 255.0f);
+                }
+            glGenBuffers(1, &skinVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, skinVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinVertex), skin, GL_STATIC_DRAW);
+            // ids
+            glEnableVertexAttribArray(5);
+            glVertexAttribIPointer(5, 4, GL_UNSIGNED_SHORT, sizeof(SkinVertex), (void*)offsetof(SkinVertex, ids));
+            // weights
+            glEnableVertexAttribArray(6);
+            glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, weights));
+        }
+
+        // depth only: the same positions and indices
+        glBindVertexArray(DepthVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 };
 #endif
\ No newline at end of file
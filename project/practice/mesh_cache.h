@@ -0,0 +1,241 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Cooked models: the final vertex and index buffers of every mesh after the Assimp import, their
+// ranges, simplified levels of detail, optimizer statistics, material texture references and bounds
+// in one file next to the source
+// (<model>.cooked). The file is memory mapped on load and its arrays handed straight to the mesh
+// upload. It is tied to the source by a content hash, so editing the model re-cooks it.
+
+#define MESH_CACHE_EXTENSION ".cooked"
+#define MESH_CACHE_VERSION 3
+#define MESH_CACHE_ALIGNMENT 16
+
+struct CookedModelHeader {
+    char     magic[4];          // "PMDL"
+    uint32_t version;
+    uint64_t sourceHash;        // hashFile() of the source model, seeded with the import settings
+    uint32_t vertexSize;        // sizeof(Vertex) the file was written with
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t reserved;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    float    boundsMin[3];
+    float    boundsMax[3];
+    uint64_t meshOffset;        // CookedSubmesh[meshCount]
+    uint64_t textureOffset;     // CookedTextureRef[textureCount]
+    uint64_t vertexOffset;      // Vertex[vertexCount]
+    uint64_t indexOffset;       // uint32_t[indexCount], relative to each mesh's first vertex; all
+                                // meshes' full index lists, then all their levels of detail
+};
+
+struct CookedSubmesh {
+    uint64_t firstVertex;
+    uint64_t vertexCount;
+    uint64_t firstIndex;
+    uint64_t indexCount;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    float    boundsMin[3];
+    float    boundsMax[3];
+    uint32_t lodCount;                          // simplified levels, MeshLod order
+    float    lodError[MESH_LOD_LEVELS];
+    uint64_t lodFirstIndex[MESH_LOD_LEVELS];
+    uint64_t lodIndexCount[MESH_LOD_LEVELS];
+    MeshOptimizeStats optimizeStats;            // the import optimizer's report, shown again on load
+};
+
+struct CookedTextureRef {
+    char type[32];              // sampler prefix, e.g. "texture_diffuse"
+    char path[224];             // as referenced by the material
+};
+
+// read side: validates the mapping once, then hands out typed views into it
+class CookedModel
+{
+public:
+    bool Open(const std::string& path, uint64_t sourceHash)
+    {
+        if (!file.Open(path))
+            return false;
+        if (!validate(sourceHash))
+        {
+            file.Close();
+            return false;
+        }
+        return true;
+    }
+
+    const CookedModelHeader& Header() const { return *(const CookedModelHeader*)file.Data(); }
+    const CookedSubmesh* Meshes() const { return (const CookedSubmesh*)(file.Data() + Header().meshOffset); }
+    const CookedTextureRef* Textures() const { return (const CookedTextureRef*)(file.Data() + Header().textureOffset); }
+    const Vertex* Vertices() const { return (const Vertex*)(file.Data() + Header().vertexOffset); }
+    const uint32_t* Indices() const { return (const uint32_t*)(file.Data() + Header().indexOffset); }
+
+private:
+    MappedFile file;
+
+    bool validate(uint64_t sourceHash) const
+    {
+        if (file.Size() < sizeof(CookedModelHeader))
+            return false;
+        const CookedModelHeader& header = Header();
+        if (std::memcmp(header.magic, "PMDL", 4) != 0 || header.version != MESH_CACHE_VERSION
+            || header.vertexSize != sizeof(Vertex) || header.sourceHash != sourceHash)
+            return false;
+        // every array has to lie inside the file
+        if (!fits(header.meshOffset, header.meshCount * sizeof(CookedSubmesh))
+            || !fits(header.textureOffset, header.textureCount * sizeof(CookedTextureRef))
+            || !fits(header.vertexOffset, header.vertexCount * sizeof(Vertex))
+            || !fits(header.indexOffset, header.indexCount * sizeof(uint32_t)))
+            return false;
+        const CookedSubmesh* meshes = Meshes();
+        for (uint32_t i = 0; i < header.meshCount; ++i)
+        {
+            if (meshes[i].firstVertex + meshes[i].vertexCount > header.vertexCount
+                || meshes[i].firstIndex + meshes[i].indexCount > header.indexCount
+                || (uint64_t)meshes[i].firstTexture + meshes[i].textureCount > header.textureCount
+                || meshes[i].lodCount > MESH_LOD_LEVELS)
+                return false;
+            for (uint32_t l = 0; l < meshes[i].lodCount; ++l)
+                if (meshes[i].lodFirstIndex[l] + meshes[i].lodIndexCount[l] > header.indexCount)
+                    return false;
+        }
+        return true;
+    }
+
+    bool fits(uint64_t offset, uint64_t bytes) const
+    {
+        return offset % MESH_CACHE_ALIGNMENT == 0 && offset <= file.Size() && bytes <= file.Size() - offset;
+    }
+};
+
+// write side: one call after a fresh import; optimizeStats has one entry per mesh
+inline bool writeCookedModel(const std::string& path, uint64_t sourceHash, const std::vector<Mesh>& meshes,
+                             const std::vector<MeshOptimizeStats>& optimizeStats, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    auto align = [](uint64_t offset) { return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1); };
+
+    CookedModelHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "PMDL", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = (uint32_t)meshes.size();
+    for (int c = 0; c < 3; ++c)
+    {
+        header.boundsMin[c] = boundsMin[c];
+        header.boundsMax[c] = boundsMax[c];
+    }
+
+    std::vector<CookedSubmesh> submeshes(meshes.size());
+    std::vector<CookedTextureRef> textures;
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        const Mesh& mesh = meshes[i];
+        CookedSubmesh& submesh = submeshes[i];
+        std::memset(&submesh, 0, sizeof(submesh));
+        submesh.firstVertex = header.vertexCount;
+        submesh.vertexCount = mesh.vertices.size();
+        submesh.firstIndex = header.indexCount;
+        submesh.indexCount = mesh.indices.size();
+        submesh.firstTexture = (uint32_t)textures.size();
+        submesh.textureCount = (uint32_t)mesh.textures.size();
+        if (i < optimizeStats.size())
+            submesh.optimizeStats = optimizeStats[i];
+        for (int c = 0; c < 3; ++c)
+        {
+            submesh.boundsMin[c] = mesh.boundsMin[c];
+            submesh.boundsMax[c] = mesh.boundsMax[c];
+        }
+        for (const Texture& texture : mesh.textures)
+        {
+            CookedTextureRef ref;
+            std::memset(&ref, 0, sizeof(ref));
+            if (texture.type.size() >= sizeof(ref.type) || texture.path.size() >= sizeof(ref.path))
+            {
+                std::cout << "ERROR::MESH_CACHE::TEXTURE_PATH_TOO_LONG: " << texture.path << std::endl;
+                return false;
+            }
+            std::memcpy(ref.type, texture.type.c_str(), texture.type.size());
+            std::memcpy(ref.path, texture.path.c_str(), texture.path.size());
+            textures.push_back(ref);
+        }
+        header.vertexCount += mesh.vertices.size();
+        header.indexCount += mesh.indices.size();
+    }
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        const Mesh& mesh = meshes[i];
+        CookedSubmesh& submesh = submeshes[i];
+        submesh.lodCount = (uint32_t)std::min<size_t>(mesh.lods.size(), MESH_LOD_LEVELS);
+        for (uint32_t l = 0; l < submesh.lodCount; ++l)
+        {
+            submesh.lodError[l] = mesh.lods[l].error;
+            submesh.lodFirstIndex[l] = header.indexCount;
+            submesh.lodIndexCount[l] = mesh.lods[l].indices.size();
+            header.indexCount += mesh.lods[l].indices.size();
+        }
+    }
+    header.textureCount = (uint32_t)textures.size();
+    header.meshOffset = align(sizeof(CookedModelHeader));
+    header.textureOffset = align(header.meshOffset + submeshes.size() * sizeof(CookedSubmesh));
+    header.vertexOffset = align(header.textureOffset + textures.size() * sizeof(CookedTextureRef));
+    header.indexOffset = align(header.vertexOffset + header.vertexCount * sizeof(Vertex));
+
+    // written to a temporary name first so a reader never maps a half written file
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    uint64_t written = 0;
+    auto write = [&](const void* data, uint64_t bytes) {
+        out.write((const char*)data, (std::streamsize)bytes);
+        written += bytes;
+    };
+    auto pad = [&](uint64_t offset) {
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        write(zeros, offset - written);
+    };
+    write(&header, sizeof(header));
+    pad(header.meshOffset);
+    write(submeshes.data(), submeshes.size() * sizeof(CookedSubmesh));
+    pad(header.textureOffset);
+    write(textures.data(), textures.size() * sizeof(CookedTextureRef));
+    pad(header.vertexOffset);
+    for (const Mesh& mesh : meshes)
+        write(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    pad(header.indexOffset);
+    for (const Mesh& mesh : meshes)
+        write(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < meshes.size(); ++i)
+        for (uint32_t l = 0; l < submeshes[i].lodCount; ++l)
+            write(meshes[i].lods[l].indices.data(), meshes[i].lods[l].indices.size() * sizeof(uint32_t));
+    out.close();
+    if (!out)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Import post-processing for triangle lists: weld identical vertices, reorder triangles for the
+// post-transform cache (optimizeVertexCache) and then for overdraw, and finally renumber the
+// vertices in first use order so fetches walk the vertex buffer front to back. V is the vertex
+// struct (needs Position, compared bytewise so it must be trivially copyable without padding).
+
+// ACMR after every pass, for the load report; the cooked model cache stores them with the mesh
+// (plain data: it is written to the file as is)
+struct MeshOptimizeStats {
+    float acmrImported;
+    float acmrWelded;
+    float acmrCache;
+    float acmrOverdraw;
+    uint32_t verticesImported;
+    uint32_t verticesWelded;
+};
+
+// merges bitwise identical vertices; returns the new vertex count
+template <class V>
+size_t weldVertices(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+{
+    struct Key {
+        const V* vertex;
+        bool operator==(const Key& other) const { return std::memcmp(vertex, other.vertex, sizeof(V)) == 0; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            const unsigned char* p = (const unsigned char*)key.vertex;
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < sizeof(V); ++i)
+                hash = (hash ^ p[i]) * 0x100000001b3ull;
+            return (size_t)hash;
+        }
+    };
+    std::unordered_map<Key, unsigned int, KeyHash> unique;
+    unique.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    size_t count = 0;
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        auto inserted = unique.insert(std::make_pair(Key{ &vertices[v] }, (unsigned int)count));
+        if (inserted.second)
+        {
+            if (count != v)
+            {
+                // keys point into the array, so an entry moved down has to be re-keyed
+                vertices[count] = vertices[v];
+                unique.erase(inserted.first);
+                unique.insert(std::make_pair(Key{ &vertices[count] }, (unsigned int)count));
+            }
+            ++count;
+        }
+        remap[v] = inserted.second ? (unsigned int)(count - 1) : inserted.first->second;
+    }
+    vertices.resize(count);
+    for (unsigned int& index : indices)
+        index = remap[index];
+    return count;
+}
+
+// reorders cache optimized triangles to cut overdraw without giving up the cache order (after
+// Sander et al., "Fast triangle reordering for vertex locality and reduced overdraw"): the list is
+// split into clusters where the cache goes cold anyway, and clusters facing away from the mesh
+// center - the ones that tend to occlude the rest - are drawn first
+template <class V>
+void optimizeOverdraw(unsigned int* indices, size_t indexCount, const V* vertices, size_t vertexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // cluster starts: triangles whose three vertices all miss a FIFO cache
+    std::vector<size_t> clusters;
+    {
+        std::vector<unsigned int> timestamp(vertexCount, 0);
+        unsigned int time = VERTEX_CACHE_FIFO_SIZE + 1;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            int misses = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = indices[t * 3 + c];
+                if (time - timestamp[v] > VERTEX_CACHE_FIFO_SIZE)
+                {
+                    timestamp[v] = time++;
+                    ++misses;
+                }
+            }
+            if (t == 0 || misses == 3)
+                clusters.push_back(t);
+        }
+    }
+    clusters.push_back(triangleCount);
+    size_t clusterCount = clusters.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    // area weighted centroids and normals
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> centers(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+    for (size_t k = 0; k < clusterCount; ++k)
+    {
+        float area = 0.0f;
+        for (size_t t = clusters[k]; t < clusters[k + 1]; ++t)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            normals[k] += n;
+            centers[k] += (p0 + p1 + p2) * (a / 3.0f);
+            area += a;
+        }
+        meshCenter += centers[k];
+        meshArea += area;
+        centers[k] = area > 0.0f ? centers[k] / area : vertices[indices[clusters[k] * 3]].Position;
+    }
+    if (meshArea <= 0.0f)
+        return;
+    meshCenter /= meshArea;
+
+    std::vector<float> sortKey(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t k = 0; k < clusterCount; ++k)
+    {
+        float length = glm::length(normals[k]);
+        sortKey[k] = length > 0.0f ? glm::dot(centers[k] - meshCenter, normals[k] / length) : 0.0f;
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indexCount);
+    for (size_t k : order)
+        result.insert(result.end(), indices + clusters[k] * 3, indices + clusters[k + 1] * 3);
+    std::copy(result.begin(), result.end(), indices);
+}
+
+// renumbers the vertices in the order the indices first use them, dropping unused ones; returns
+// the old index of every new vertex (so extra per-vertex data can follow)
+template <class V>
+std::vector<unsigned int> optimizeVertexFetch(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<unsigned int> source;
+    source.reserve(vertices.size());
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (unsigned int)source.size();
+            source.push_back(index);
+        }
+        index = remap[index];
+    }
+    std::vector<V> reordered(source.size());
+    for (size_t v = 0; v < source.size(); ++v)
+        reordered[v] = vertices[source[v]];
+    vertices.swap(reordered);
+    return source;
+}
+
+// the whole chain; indices stay a triangle list over the (possibly fewer) vertices
+template <class V>
+MeshOptimizeStats optimizeMesh(std::vector<V>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizeStats stats = {};
+    stats.verticesImported = (uint32_t)vertices.size();
+    stats.acmrImported = computeACMR(indices.data(), indices.size(), vertices.size());
+
+    weldVertices(vertices, indices);
+    stats.verticesWelded = (uint32_t)vertices.size();
+    stats.acmrWelded = computeACMR(indices.data(), indices.size(), vertices.size());
+
+    optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+    stats.acmrCache = computeACMR(indices.data(), indices.size(), vertices.size());
+
+    optimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+    stats.acmrOverdraw = computeACMR(indices.data(), indices.size(), vertices.size());
+
+    optimizeVertexFetch(vertices, indices);
+    return stats;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Import time level of detail chain: quadric error edge collapses (Garland & Heckbert) that only
+// ever move a vertex onto one of its neighbours, so every level is just another index buffer over
+// the mesh's own vertices. Collapses work on positions, not vertices, so meshes that come out of
+// the importer unwelded (a vertex per corner) still simplify; a corner whose position went away
+// takes the vertex at the new position whose normal and texture coords are closest. Open borders
+// are kept in place.
+
+#define MESH_LOD_LEVELS 3           // coarser levels after the full mesh
+#define MESH_LOD_RATIO 0.5f         // triangle count of each level relative to the one before
+#define MESH_LOD_MIN_TRIANGLES 64   // meshes this small aren't simplified
+#define MESH_LOD_MIN_GAIN 0.8f      // a level that keeps more than this of the previous one ends the chain
+
+struct MeshLod {
+    std::vector<unsigned int> indices;
+    float error = 0.0f;             // object space deviation from the full mesh
+};
+
+namespace mesh_simplify {
+
+// symmetric 4x4 quadric, upper triangle
+struct Quadric {
+    double a[10];
+
+    Quadric() { std::memset(a, 0, sizeof(a)); }
+
+    static Quadric Plane(const glm::dvec3& n, double d)
+    {
+        Quadric q;
+        q.a[0] = n.x * n.x; q.a[1] = n.x * n.y; q.a[2] = n.x * n.z; q.a[3] = n.x * d;
+        q.a[4] = n.y * n.y; q.a[5] = n.y * n.z; q.a[6] = n.y * d;
+        q.a[7] = n.z * n.z; q.a[8] = n.z * d;
+        q.a[9] = d * d;
+        return q;
+    }
+
+    void Add(const Quadric& other)
+    {
+        for (int i = 0; i < 10; ++i)
+            a[i] += other.a[i];
+    }
+
+    // sum of squared distances of p to the accumulated planes
+    double Evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                 + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                 + a[7] * z * z + 2 * a[8] * z
+                 + a[9];
+        return std::max(e, 0.0);
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from, to;
+    bool operator<(const Collapse& other) const { return cost > other.cost; }   // min heap
+};
+
+} // namespace mesh_simplify
+
+// builds up to MESH_LOD_LEVELS coarser index buffers for a triangle list; V needs Position, Normal
+// and TexCoords. Levels that wouldn't save enough are left out, so lods may come back short.
+template <class V>
+void buildLodChain(const std::vector<V>& vertices, const std::vector<unsigned int>& indices, std::vector<MeshLod>& lods)
+{
+    using namespace mesh_simplify;
+    lods.clear();
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < MESH_LOD_MIN_TRIANGLES)
+        return;
+
+    // weld by position: groups are what gets collapsed
+    std::vector<uint32_t> group(vertices.size());
+    std::vector<glm::vec3> positions;
+    {
+        struct PositionHash {
+            size_t operator()(const glm::vec3& p) const
+            {
+                uint32_t h[3];
+                std::memcpy(h, &p, sizeof(h));
+                return h[0] * 73856093u ^ h[1] * 19349663u ^ h[2] * 83492791u;
+            }
+        };
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> groups;
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            auto inserted = groups.insert(std::make_pair(vertices[v].Position, (uint32_t)positions.size()));
+            if (inserted.second)
+                positions.push_back(vertices[v].Position);
+            group[v] = inserted.first->second;
+        }
+    }
+    size_t groupCount = positions.size();
+    std::vector<std::vector<uint32_t>> members(groupCount);
+    for (size_t v = 0; v < vertices.size(); ++v)
+        members[group[v]].push_back((uint32_t)v);
+
+    // triangles over groups; degenerate ones are dropped up front
+    std::vector<uint32_t> corners;      // original vertex per corner
+    std::vector<uint32_t> tris;         // current group per corner
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        uint32_t g0 = group[indices[t * 3]], g1 = group[indices[t * 3 + 1]], g2 = group[indices[t * 3 + 2]];
+        if (g0 == g1 || g1 == g2 || g0 == g2)
+            continue;
+        for (int c = 0; c < 3; ++c)
+            corners.push_back(indices[t * 3 + c]);
+        tris.push_back(g0);
+        tris.push_back(g1);
+        tris.push_back(g2);
+    }
+    size_t live = tris.size() / 3;
+    std::vector<unsigned char> removed(live, 0);
+
+    std::vector<Quadric> quadrics(groupCount);
+    std::vector<std::vector<uint32_t>> adjacent(groupCount);
+    std::unordered_map<uint64_t, int> edgeUses;
+    for (size_t t = 0; t < live; ++t)
+    {
+        const uint32_t* g = &tris[t * 3];
+        glm::dvec3 p0(positions[g[0]]), p1(positions[g[1]]), p2(positions[g[2]]);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(n);
+        if (length > 0.0)
+        {
+            n /= length;
+            Quadric plane = Quadric::Plane(n, -glm::dot(n, p0));
+            for (int c = 0; c < 3; ++c)
+                quadrics[g[c]].Add(plane);
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            adjacent[g[c]].push_back((uint32_t)t);
+            uint32_t a = g[c], b = g[(c + 1) % 3];
+            ++edgeUses[(uint64_t)std::min(a, b) << 32 | std::max(a, b)];
+        }
+    }
+    std::vector<unsigned char> locked(groupCount, 0);
+    for (const auto& edge : edgeUses)
+        if (edge.second == 1)
+        {
+            locked[edge.first >> 32] = 1;
+            locked[edge.first & 0xffffffffu] = 1;
+        }
+
+    std::vector<uint32_t> collapsedInto(groupCount);
+    for (size_t g = 0; g < groupCount; ++g)
+        collapsedInto[g] = (uint32_t)g;
+    auto find = [&](uint32_t g) {
+        while (collapsedInto[g] != g)
+        {
+            collapsedInto[g] = collapsedInto[collapsedInto[g]];
+            g = collapsedInto[g];
+        }
+        return g;
+    };
+    auto cost = [&](uint32_t from, uint32_t to) {
+        Quadric q = quadrics[from];
+        q.Add(quadrics[to]);
+        return q.Evaluate(positions[to]);
+    };
+
+    std::priority_queue<Collapse> heap;
+    auto pushEdges = [&](uint32_t g) {
+        for (uint32_t t : adjacent[g])
+        {
+            if (removed[t])
+                continue;
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t other = tris[t * 3 + c];
+                if (other == g)
+                    continue;
+                if (!locked[g])
+                    heap.push(Collapse{ cost(g, other), g, other });
+                if (!locked[other])
+                    heap.push(Collapse{ cost(other, g), other, g });
+            }
+        }
+    };
+    for (size_t t = 0; t < live; ++t)
+        for (int c = 0; c < 3; ++c)
+        {
+            uint32_t a = tris[t * 3 + c], b = tris[t * 3 + (c + 1) % 3];
+            if (!locked[a])
+                heap.push(Collapse{ cost(a, b), a, b });
+            if (!locked[b])
+                heap.push(Collapse{ cost(b, a), b, a });
+        }
+
+    // moving from onto to must not fold any remaining triangle over
+    auto flips = [&](uint32_t from, uint32_t to) {
+        for (uint32_t t : adjacent[from])
+        {
+            if (removed[t])
+                continue;
+            const uint32_t* g = &tris[t * 3];
+            if (g[0] == to || g[1] == to || g[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                p[c] = positions[g[c]];
+                q[c] = g[c] == from ? positions[to] : p[c];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    };
+
+    // a corner whose position was collapsed away takes the closest matching vertex at its new one
+    auto resolve = [&](uint32_t vertex, uint32_t target) {
+        if (group[vertex] == target)
+            return vertex;
+        const V& original = vertices[vertex];
+        uint32_t best = members[target][0];
+        float bestDistance = 1e30f;
+        for (uint32_t candidate : members[target])
+        {
+            glm::vec3 dn = vertices[candidate].Normal - original.Normal;
+            glm::vec2 dt = vertices[candidate].TexCoords - original.TexCoords;
+            float distance = glm::dot(dn, dn) + glm::dot(dt, dt);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = candidate;
+            }
+        }
+        return best;
+    };
+
+    size_t previous = live;
+    double error = 0.0;
+    for (int level = 0; level < MESH_LOD_LEVELS; ++level)
+    {
+        size_t target = (size_t)(previous * MESH_LOD_RATIO);
+        while (live > target && !heap.empty())
+        {
+            Collapse collapse = heap.top();
+            heap.pop();
+            uint32_t from = collapse.from, to = collapse.to;
+            if (find(from) != from || find(to) != to)
+                continue;
+            double current = cost(from, to);
+            if (current > collapse.cost * 1.0001 + 1e-12)
+            {
+                heap.push(Collapse{ current, from, to });  // the quadrics changed since it was queued
+                continue;
+            }
+            if (flips(from, to))
+                continue;
+
+            collapsedInto[from] = to;
+            quadrics[to].Add(quadrics[from]);
+            error = std::max(error, std::sqrt(current));
+            for (uint32_t t : adjacent[from])
+            {
+                if (removed[t])
+                    continue;
+                uint32_t* g = &tris[t * 3];
+                if (g[0] == to || g[1] == to || g[2] == to)
+                {
+                    removed[t] = 1;
+                    --live;
+                    continue;
+                }
+                for (int c = 0; c < 3; ++c)
+                    if (g[c] == from)
+                        g[c] = to;
+                adjacent[to].push_back(t);
+            }
+            adjacent[from].clear();
+            pushEdges(to);
+        }
+        if (live > previous * MESH_LOD_MIN_GAIN)
+            break;
+
+        MeshLod lod;
+        lod.error = (float)error;
+        lod.indices.reserve(live * 3);
+        for (size_t t = 0; t < removed.size(); ++t)
+            if (!removed[t])
+                for (int c = 0; c < 3; ++c)
+                    lod.indices.push_back(resolve(corners[t * 3 + c], tris[t * 3 + c]));
+        lods.push_back(lod);
+        previous = live;
+        if (live < MESH_LOD_MIN_TRIANGLES)
+            break;
+    }
+}
+
+#endif
@@ -14,96 +14,306 @@
 
 #include "mesh.h"
 #include "shader_s.h"
+#include "draw_list.h"
+#include "mesh_cache.h"
+#include "memory_stats.h"
+#include "thread_pool.h"
+#include "texture_cache.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <map>
 #include <vector>
 
 using namespace std;
 
+// post processing every import runs; part of the cooked cache key
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace)
+
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// one mesh's CPU side data between the (parallel) conversion and the (serial) GL upload;
+// texture ids are still 0 here, only type and path are known
+struct ImportedMesh {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures;
+    vector<MeshLod>      lods;
+    MeshOptimizeStats    optimizeStats = {};
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+};
+
 class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every texture the model holds a TextureCache reference to, one entry per file
     vector<Mesh>    meshes;
+    vector<MeshOptimizeStats> optimizeStats;    // per mesh, from the import (or the cooked file)
     string directory;
     bool gammaCorrection;
+    GeometryArena* arena;
+    bool keepCpuData;       // false: the meshes drop their vertex/index copies once uploaded
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);   // object space, all meshes
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. Pass an arena to sub-allocate the meshes from
+    // it so the model can be submitted with the rest of the scene's draw list.
+    Model(string const& path, bool gamma = false, GeometryArena* arena = nullptr, bool keepCpuData = true)
+        : gammaCorrection(gamma), arena(arena), keepCpuData(keepCpuData)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // the meshes' GL objects are shared by copies, so a model is moved around by pointer
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    ~Model()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureCache::Get().Release(textures_loaded[i].id);
+    }
+
+    // draws the model, and thus all its meshes; textures shared with the previous mesh stay bound
     void Draw(Shader& shader)
+    {
+        TextureBindState bindState;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(shader, &bindState);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws all meshes for a depth-only pass (position stream only)
+    void DrawDepth()
     {
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawDepth();
+    }
+
+    // records every mesh into a draw list (arena models only) with its first diffuse texture as
+    // the material; meshes without one use the texture the pass bound
+    void Submit(SceneDrawList& scene, const glm::mat4& model, unsigned int flags = 0)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (!meshes[i].arena)
+                continue;
+            unsigned int material = 0;
+            for (unsigned int t = 0; t < meshes[i].textures.size() && material == 0; t++)
+                if (meshes[i].textures[t].type == "texture_diffuse")
+                    material = meshes[i].textures[t].id;
+            scene.Add(meshes[i].arenaMesh, model, flags, material);
+        }
     }
 
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // a cooked copy (<path>.cooked) whose hash still matches the source is loaded instead, and
+    // written after a fresh import otherwise. Mesh conversion and texture decoding run on the
+    // shared thread pool; only the GL uploads happen on this (the context) thread.
     void loadModel(string const& path)
     {
+        TRACE_ZONE("load model");
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        uint64_t sourceHash = 0;
+        bool hashed = hashFile(path, sourceHash, hashBytes("model import", 12) ^ (uint64_t)MODEL_IMPORT_FLAGS);
+        string cookedPath = path + MESH_CACHE_EXTENSION;
+        vector<ImportedMesh> imported;
+        if (hashed && loadCooked(cookedPath, sourceHash, imported))
+        {
+            createMeshes(imported);
+            finishLoad(path);
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene;
+        {
+            TRACE_ZONE("assimp import");
+            scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+        }
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        // process ASSIMP's root node recursively, collecting the meshes in node order
+        vector<const aiMesh*> order;
+        processNode(scene->mRootNode, scene, order);
+        // convert them all in parallel
+        imported.resize(order.size());
+        {
+            TRACE_ZONE("convert meshes");
+            ThreadPool::Shared().ParallelFor(order.size(), [&](size_t i) {
+                TRACE_ZONE("convert mesh");
+                imported[i] = processMesh(order[i], scene);
+            });
+        }
+        createMeshes(imported);
+        updateBounds();
+
+        if (hashed && !writeCookedModel(cookedPath, sourceHash, meshes, optimizeStats, boundsMin, boundsMax))
+            cout << "ERROR::MESH_CACHE::WRITE_FAILED: " << cookedPath << endl;
+        finishLoad(path);
+    }
+
+    // drops the CPU copies if asked to and reports what the load left behind
+    void finishLoad(string const& path)
+    {
+        size_t vertexCount = 0, cpuBytes = 0;
+        for (Mesh& mesh : meshes)
+        {
+            vertexCount += mesh.vertices.size();
+            if (!keepCpuData)
+                mesh.ReleaseCpuData();
+            cpuBytes += mesh.CpuBytes();
+        }
+        ProcessMemory memory = processMemory();
+        const double mb = 1.0 / (1024.0 * 1024.0);
+        cout << "Model " << path << ": " << meshes.size() << " meshes, " << vertexCount << " vertices, "
+             << cpuBytes * mb << " MB CPU copies kept; process resident " << memory.resident * mb
+             << " MB, peak " << memory.peak * mb << " MB, staging peak " << LinearArena::Staging().Peak() * mb << " MB" << endl;
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // ACMR after each optimizer pass, averaged over the meshes by triangle count
+        double acmr[4] = { 0.0, 0.0, 0.0, 0.0 }, triangles = 0.0;
+        size_t importedVertices = 0, weldedVertices = 0;
+        for (size_t i = 0; i < optimizeStats.size() && i < meshes.size(); i++)
+        {
+            const MeshOptimizeStats& stats = optimizeStats[i];
+            double weight = meshes[i].indexCount / 3.0;
+            acmr[0] += stats.acmrImported * weight;
+            acmr[1] += stats.acmrWelded * weight;
+            acmr[2] += stats.acmrCache * weight;
+            acmr[3] += stats.acmrOverdraw * weight;
+            triangles += weight;
+            importedVertices += stats.verticesImported;
+            weldedVertices += stats.verticesWelded;
+        }
+        if (triangles > 0.0)
+            cout << "  vertices " << importedVertices << " imported, " << weldedVertices << " after welding; ACMR imported "
+                 << acmr[0] / triangles << ", welded " << acmr[1] / triangles << ", cache order " << acmr[2] / triangles
+                 << ", overdraw order " << acmr[3] / triangles << endl;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // reads the meshes from a cooked file; false if it's missing, stale or damaged
+    bool loadCooked(string const& cookedPath, uint64_t sourceHash, vector<ImportedMesh>& imported)
+    {
+        TRACE_ZONE("load cooked model");
+        CookedModel cooked;
+        if (!cooked.Open(cookedPath, sourceHash))
+            return false;
+        const CookedModelHeader& header = cooked.Header();
+        const CookedSubmesh* submeshes = cooked.Meshes();
+        const CookedTextureRef* refs = cooked.Textures();
+        imported.resize(header.meshCount);
+        ThreadPool::Shared().ParallelFor(header.meshCount, [&](size_t i) {
+            const CookedSubmesh& submesh = submeshes[i];
+            const Vertex* firstVertex = cooked.Vertices() + submesh.firstVertex;
+            const uint32_t* firstIndex = cooked.Indices() + submesh.firstIndex;
+            ImportedMesh& mesh = imported[i];
+            mesh.vertices.assign(firstVertex, firstVertex + submesh.vertexCount);
+            mesh.indices.assign(firstIndex, firstIndex + submesh.indexCount);
+            for (uint32_t t = 0; t < submesh.textureCount; ++t)
+            {
+                const CookedTextureRef& ref = refs[submesh.firstTexture + t];
+                Texture texture;
+                texture.id = 0;
+                texture.type = ref.type;
+                texture.path = ref.path;
+                mesh.textures.push_back(texture);
+            }
+            mesh.boundsMin = glm::vec3(submesh.boundsMin[0], submesh.boundsMin[1], submesh.boundsMin[2]);
+            mesh.boundsMax = glm::vec3(submesh.boundsMax[0], submesh.boundsMax[1], submesh.boundsMax[2]);
+            mesh.optimizeStats = submesh.optimizeStats;
+            mesh.lods.resize(submesh.lodCount);
+            for (uint32_t l = 0; l < submesh.lodCount; ++l)
+            {
+                const uint32_t* lodIndex = cooked.Indices() + submesh.lodFirstIndex[l];
+                mesh.lods[l].indices.assign(lodIndex, lodIndex + submesh.lodIndexCount[l]);
+                mesh.lods[l].error = submesh.lodError[l];
+            }
+        });
+        boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+        return true;
+    }
+
+    // context thread: resolves textures, then creates the GL side of every mesh in order
+    void createMeshes(vector<ImportedMesh>& imported)
+    {
+        loadTextures(imported);
+        TRACE_ZONE("upload meshes");
+        meshes.reserve(meshes.size() + imported.size());
+        for (ImportedMesh& mesh : imported)
+        {
+            optimizeStats.push_back(mesh.optimizeStats);
+            // the imported buffers move into the mesh, which uploads them from there
+            meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), std::move(mesh.textures), arena,
+                                VERTEX_FORMAT_COMPACT, std::move(mesh.lods));
+            meshes.back().boundsMin = mesh.boundsMin;
+            meshes.back().boundsMax = mesh.boundsMax;
+        }
+    }
+
+    void updateBounds()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            boundsMin = i == 0 ? meshes[i].boundsMin : glm::min(boundsMin, meshes[i].boundsMin);
+            boundsMax = i == 0 ? meshes[i].boundsMax : glm::max(boundsMax, meshes[i].boundsMax);
+        }
+    }
+
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode* node, const aiScene* scene, vector<const aiMesh*>& order)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            order.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, order);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // worker thread: no GL calls in here
+    ImportedMesh processMesh(const aiMesh* mesh, const aiScene* scene)
     {
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        glm::vec3 meshMin(0.0f), meshMax(0.0f);
+        // sized up front (the import triangulates, so every face has 3 indices); zeroed vertices
+        // also leave no garbage bone weights behind
+        vertices.resize(mesh->mNumVertices);
+        indices.reserve((size_t)mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex& vertex = vertices[i];
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            meshMin = i == 0 ? vector : glm::min(meshMin, vector);
+            meshMax = i == 0 ? vector : glm::max(meshMax, vector);
             // normals
             if (mesh->HasNormals())
             {
@@ -134,8 +344,6 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -167,12 +375,28 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data: welded and reordered for the GPU caches, with the
+        // simplified levels of detail (cache ordered as well) built on top
+        ImportedMesh result;
+        {
+            TRACE_ZONE("optimize mesh");
+            result.optimizeStats = optimizeMesh(vertices, indices);
+        }
+        {
+            TRACE_ZONE("simplify mesh");
+            buildLodChain(vertices, indices, result.lods);
+            for (MeshLod& lod : result.lods)
+                optimizeVertexCache(lod.indices.data(), lod.indices.size(), vertices.size());
+        }
+        result.vertices.swap(vertices);
+        result.indices.swap(indices);
+        result.textures.swap(textures);
+        result.boundsMin = meshMin;
+        result.boundsMax = meshMax;
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // lists the material textures of a given type; they're loaded later by loadTextures
     vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
@@ -180,69 +404,63 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+        return textures;
+    }
+
+    // fills in the texture ids of all meshes through the global TextureCache, which loads the files
+    // no model has loaded yet in parallel. Normal and height maps aren't colours, so their mips
+    // are filtered without the sRGB curve.
+    void loadTextures(vector<ImportedMesh>& imported)
+    {
+        TRACE_ZONE("load textures");
+        vector<string> paths[2];    // [colour data, other data]
+        for (ImportedMesh& mesh : imported)
+            for (Texture& texture : mesh.textures)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
+                vector<string>& group = paths[isColorTexture(texture.type) ? 0 : 1];
+                if (std::find(group.begin(), group.end(), texture.path) == group.end())
+                    group.push_back(texture.path);
             }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
+        vector<unsigned int> ids[2];
+        for (int g = 0; g < 2; ++g)
+        {
+            TextureCache::Get().AcquireAll(paths[g], gammaCorrection && g == 0, TEXTURE_WRAP_REPEAT, ids[g], g == 0);
+            for (size_t i = 0; i < paths[g].size(); ++i)
+            {
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+                texture.id = ids[g][i];
+                texture.path = paths[g][i];
+                textures_loaded.push_back(texture);
             }
         }
-        return textures;
+
+        for (ImportedMesh& mesh : imported)
+            for (Texture& texture : mesh.textures)
+            {
+                int g = isColorTexture(texture.type) ? 0 : 1;
+                texture.id = ids[g][std::find(paths[g].begin(), paths[g].end(), texture.path) - paths[g].begin()];
+            }
+    }
+
+    static bool isColorTexture(const string& typeName)
+    {
+        return typeName == "texture_diffuse" || typeName == "texture_specular";
     }
 };
 
 
+// the returned texture holds a TextureCache reference; give it back with TextureCache::Get().Release
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
     //string filename = string(path); 
     //filename = directory + '/' + filename;
-    
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
 
-    return textureID;
+    return TextureCache::Get().Acquire(path, gamma, TEXTURE_WRAP_REPEAT);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+
+// Capture target that doesn't depend on the window: an RGB8 color and a depth renderbuffer of any
+// size, read back from the color attachment. With it the window only provides the context, so
+// captures are neither tied to its framebuffer size nor paced by its swap interval.
+
+// where the hard shadow and the pcss image go in a capture
+enum CaptureLayout {
+    CAPTURE_SIDE_BY_SIDE,   // hard shadows left, pcss right (the window's layout)
+    CAPTURE_STACKED,        // hard shadows on top, pcss below
+    CAPTURE_HARD_ONLY,
+    CAPTURE_PCSS_ONLY
+};
+
+struct PassViewport {
+    int x, y, width, height;    // width 0: the pass isn't part of the capture
+};
+
+// viewports of the hard shadow (0) and pcss (1) passes in a width x height capture; both passes
+// always get the same size
+inline void captureViewports(CaptureLayout layout, int width, int height, PassViewport viewports[2])
+{
+    switch (layout)
+    {
+    case CAPTURE_STACKED:
+        viewports[0] = PassViewport{ 0, height / 2, width, height / 2 };
+        viewports[1] = PassViewport{ 0, 0, width, height / 2 };
+        break;
+    case CAPTURE_HARD_ONLY:
+        viewports[0] = PassViewport{ 0, 0, width, height };
+        viewports[1] = PassViewport{ 0, 0, 0, 0 };
+        break;
+    case CAPTURE_PCSS_ONLY:
+        viewports[0] = PassViewport{ 0, 0, 0, 0 };
+        viewports[1] = PassViewport{ 0, 0, width, height };
+        break;
+    default:
+        viewports[0] = PassViewport{ 0, 0, width / 2, height };
+        viewports[1] = PassViewport{ width / 2, 0, width / 2, height };
+        break;
+    }
+}
+
+class OffscreenTarget
+{
+public:
+    OffscreenTarget() {}
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    ~OffscreenTarget()
+    {
+        if (framebuffer)
+        {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &color);
+            glDeleteRenderbuffers(1, &depth);
+        }
+    }
+
+    // (re)allocates the attachments when the size changes
+    void Resize(int newWidth, int newHeight)
+    {
+        if (framebuffer == 0)
+        {
+            glGenFramebuffers(1, &framebuffer);
+            glGenRenderbuffers(1, &color);
+            glGenRenderbuffers(1, &depth);
+        }
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OFFSCREEN_TARGET::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    unsigned int Framebuffer() const { return framebuffer; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // the color attachment as tightly packed RGB rows, bottom row first
+    void ReadBack(std::vector<unsigned char>& pixels)
+    {
+        pixels.resize((size_t)width * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+private:
+    unsigned int framebuffer = 0, color = 0, depth = 0;
+    int width = 0, height = 0;
+};
+
+#endif
@@ -9,11 +9,29 @@
 #include "camera_s.h"
 #include "stb_image.h"
 #include "stb_image_write.h"
+#include "trace.h"
+#include "gl_ext.h"
+#include "geometry_arena.h"
+#include "draw_list.h"
+#include "scene_generator.h"
+#include "camera_sampler.h"
+#include "layered_views.h"
+#include "offscreen_target.h"
+#include "manifest.h"
+#include "image_encoder.h"
+#include "shard_launcher.h"
+#include "frame_ring.h"
+#include "texture_cache.h"
 //#include "model.h"
 
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
 
 #define M_PI 3.14159265358979323846
 
@@ -23,14 +41,17 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 
 unsigned int loadTexture(const char* path);
-void renderScene(const Shader& shader);
-void renderCube();
-void renderSphere();
-void renderTriangle();
-void renderCone();
-void renderTriangularPrism();
+glm::vec3 buildScene(SceneDrawList& scene);
 
 void take_screenshot();
+void save_screenshot(const unsigned char* pixels, int width, int height);
+void publish_frame(const unsigned char* pixels, int width, int height);
+int shotsPerLight();
+uint64_t captureCount();
+uint64_t currentSampleId();
+std::string manifestPath(const std::string& directory);
+int launchShards(const char* argv0, unsigned int count);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
 int sceneCounter = 3;
 int lightCounter = 1;
 int screenshotCounter = 1;
@@ -41,8 +62,43 @@ const unsigned int SCR_WIDTH = 512;
 const unsigned int SCR_HEIGHT = 256;
 bool shadows = true;
 bool spacePressed = false;
+bool recordTrace = true;        // record instrumentation zones, dumped to trace.json at exit or with F12
+bool f12Pressed = false;
+bool streamTextures = true;     // load textures in the background behind a placeholder (texture_stream.h)
 //glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
 glm::vec3 lightPos[10];
+SceneDrawList sceneDraws;       // rebuilt every frame, drawn by every pass
+bool proceduralScenes = false;  // a fresh seeded scene per screenshot (scene_generator.h) instead of the hand-written ones
+uint64_t sceneSeed = 1;
+uint64_t sceneSample = 0;       // sample the next frames show, advanced by every screenshot
+uint64_t sceneSampleCount = 10000;
+SceneGenerator sceneGenerator;
+bool sampleCameras = false;     // capture viewsPerLight sampled viewpoints (camera_sampler.h) against each light's depth cubemap instead of the free camera
+unsigned int viewsPerLight = 10;
+CameraSampleMode cameraSampleMode = CAMERA_SAMPLE_MIXED;
+CameraSampler cameraSampler;
+bool layeredViews = false;      // with sampleCameras: draw a light's views LAYERED_MAX_VIEWS at a time into a texture array (layered_views.h)
+LayeredViewTarget layeredTarget;
+bool offscreen = false;         // capture into an FBO of captureWidth x captureHeight with the window hidden; the loop then runs uncapped at a fixed timestep
+int captureWidth = SCR_WIDTH;
+int captureHeight = SCR_HEIGHT;
+CaptureLayout captureLayout = CAPTURE_SIDE_BY_SIDE;
+const float FIXED_TIMESTEP = 1.0f / 60.0f;
+OffscreenTarget offscreenTarget;
+const char* OUTPUT_DIR = "C:/Users/ppoo9/Desktop/data/test/";
+bool resumeRun = true;          // skip the samples the output directory's manifest (manifest.h) already lists
+unsigned int shardIndex = 0;    // --shard i/N (shard_launcher.h): this process renders captures i, i + N, ... headless into OUTPUT_DIR/shard<i>/
+unsigned int shardCount = 1;
+std::string outputDirectory = OUTPUT_DIR;
+SampleManifest manifest;
+SampleRecord capture;           // what the next saved screenshot shows and how long it took, filled in as the frame goes
+EncoderSettings imageEncoder;   // format screenshots are written in (image_encoder.h); QOI or NPY when encoding, not the disk, is the bottleneck
+bool encoderBenchmark = false;  // print every encoder's throughput, size and error on the first screenshot
+bool publishFrames = false;     // also hand every screenshot raw to a trainer through the shared-memory ring FRAME_RING_NAME (frame_ring.h)
+bool saveImages = true;         // encode and write screenshots (and list them in the manifest); off with publishFrames the trainer gets them straight from memory
+bool ringOverwrite = false;     // when the trainer falls behind, replace its oldest unread frames instead of waiting for it
+const unsigned int FRAME_RING_SLOTS = 16;
+frame_ring frameRing;
 
 
 // camera
@@ -55,8 +111,32 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char** argv)
 {
+    // command line: --launch N runs the generation as N worker processes, --shard i/N is one of them
+    // ----------------------------------------------------------------------------------------------
+    unsigned int launchCount = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--launch") == 0 && i + 1 < argc)
+            launchCount = (unsigned int)std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--shard") == 0 && i + 1 < argc && parseShard(argv[i + 1], shardIndex, shardCount))
+            ++i;
+        else
+        {
+            std::cout << "ERROR::ARGUMENTS::UNKNOWN " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (launchCount > 0)
+        return launchShards(argv[0], launchCount);
+    if (shardCount > 1)
+    {
+        offscreen = true;
+        outputDirectory = std::string(OUTPUT_DIR) + "shard" + std::to_string(shardIndex) + "/";
+        makeDirectory(outputDirectory);
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -64,6 +144,7 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    glfwWindowHint(GLFW_VISIBLE, offscreen ? GLFW_FALSE : GLFW_TRUE);   // offscreen the window only provides the context
     glfwWindowHint(GLFW_DECORATED, GLFW_FALSE);  // ׵θ ֱ
 
 #ifdef __APPLE__
@@ -94,16 +175,26 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+    glfwSwapInterval(offscreen ? 0 : 1);
+    TextureStreamer::Get().SetEnabled(streamTextures);
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
+    // instrumentation
+    // ---------------
+    Trace::SetEnabled(recordTrace);
+    Trace::DumpAtExit("trace.json");
+    TRACE_THREAD_NAME("render");
+
     // build and compile shaders
     // -------------------------
     Shader shader("3.2.1.point_shadows.vs", "3.2.1.point_shadows.fs");
     Shader simpleDepthShader("3.2.1.point_shadows_depth.vs", "3.2.1.point_shadows_depth.fs", "3.2.1.point_shadows_depth.gs");
+    Shader layeredShader("3.2.1.point_shadows_layered.vs", "3.2.1.point_shadows.fs", "3.2.1.point_shadows_layered.gs");
 
     // load textures
     // -------------
@@ -111,6 +202,14 @@ int main()
     if (sceneCounter == 1) woodTexture = loadTexture("wood.png");
     if (sceneCounter == 2) woodTexture = loadTexture("123.png");
     if (sceneCounter == 3) woodTexture = loadTexture("456.jpg");
+    if (proceduralScenes)
+    {
+        // walls and objects pick from every texture, 0 being the one bound above
+        sceneGenerator.AddMaterial(0);
+        sceneGenerator.AddMaterial(loadTexture("wood.png"));
+        sceneGenerator.AddMaterial(loadTexture("123.png"));
+        sceneGenerator.AddMaterial(loadTexture("456.jpg"));
+    }
 
     lightPos[0] = glm::vec3(0.0f, 0.0f, 0.0f);
     lightPos[1] = glm::vec3(1.0f, 1.0f, 3.0f);
@@ -152,24 +251,84 @@ int main()
     shader.use();
     shader.setInt("diffuseTexture", 0);
     shader.setInt("depthMap", 1);
+    shader.setInt("drawData", DRAW_DATA_UNIT);
+    simpleDepthShader.use();
+    simpleDepthShader.setInt("drawData", DRAW_DATA_UNIT);
+    layeredShader.use();
+    layeredShader.setInt("diffuseTexture", 0);
+    layeredShader.setInt("depthMap", 1);
+    layeredShader.setInt("drawData", DRAW_DATA_UNIT);
+    LayeredViewTarget::BindProgram(layeredShader.ID);
+    std::vector<unsigned char> layeredPixels;
 
     // lighting info
     // -------------
     //glm::vec3 lightPos(0.0f, 0.0f, 0.0f);
 
+    // generation manifest: one per scene set (and seed), resumed from the first capture of this
+    // shard it lacks a sample of; that capture's finished shots are skipped
+    // -----------------------------------------------------------------------------------------
+    {
+        manifest.Open(manifestPath(outputDirectory));
+        uint64_t captureIndex = shardIndex;
+        auto complete = [](uint64_t c) {
+            for (int shot = 0; shot < shotsPerLight(); ++shot)
+                if (!manifest.Contains(c * shotsPerLight() + shot))
+                    return false;
+            return true;
+        };
+        while (resumeRun && captureIndex < captureCount() && complete(captureIndex))
+            captureIndex += shardCount;
+        if (captureIndex >= captureCount())
+            return 0;
+        if (proceduralScenes)
+            sceneSample = captureIndex;
+        else
+            lightCounter = 1 + (int)captureIndex;
+        screenshotCounter = 1;
+        if (manifest.Count() > 0)
+            std::cout << "Resuming at capture " << captureIndex << " (" << manifest.Count() << " samples in the manifest)" << std::endl;
+    }
+
+    // frame ring for a trainer reading the screenshots live, sized for this run's captures; every
+    // shard writes its own
+    // -----------------------------------------------------------------------------------------------
+    if (publishFrames)
+    {
+        int ringWidth = captureWidth, ringHeight = captureHeight;
+        if (!offscreen)
+            glfwGetFramebufferSize(window, &ringWidth, &ringHeight);
+        std::string ringName = FRAME_RING_NAME;
+        if (shardCount > 1)
+            ringName += "_shard" + std::to_string(shardIndex);
+        if (!frame_ring_create(&frameRing, ringName.c_str(), FRAME_RING_SLOTS, (uint32_t)ringWidth * ringHeight * 3))
+        {
+            std::cout << "ERROR::FRAME_RING::CREATE_FAILED " << ringName << std::endl;
+            publishFrames = false;
+        }
+    }
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
     {
         // per-frame time logic
         // --------------------
+        // offscreen frames come as fast as they render, so they advance by a fixed step instead
         float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
+        deltaTime = offscreen ? FIXED_TIMESTEP : currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window);
+        {
+            TRACE_ZONE("processInput");
+            processInput(window);
+        }
+
+        // finish a slice of the pending texture uploads
+        // ---------------------------------------------
+        TextureStreamer::Get().Update();
 
         // move light position over time
         //lightPos.z = static_cast<float>(sin(glfwGetTime() * 0.5) * 3.0);          //  ̵ϴ κ
@@ -179,357 +338,382 @@ int main()
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // capture size and where each pass goes in it
+        // -------------------------------------------
+        int targetWidth = offscreen ? captureWidth : (int)SCR_WIDTH;
+        int targetHeight = offscreen ? captureHeight : (int)SCR_HEIGHT;
+        PassViewport passes[2];
+        captureViewports(captureLayout, targetWidth, targetHeight, passes);
+        const PassViewport& passSize = passes[0].width > 0 ? passes[0] : passes[1];
+        float passAspect = (float)passSize.width / (float)passSize.height;
+        if (offscreen)
+            offscreenTarget.Resize(targetWidth, targetHeight);
+
+        // record the scene once for all passes; procedural scenes place their own light
+        // --------------------------------------------------------------------------------
+        GeometryArena& arena = GeometryLibrary::Get().arena;
+        sceneDraws.Clear();
+        glm::vec3 light = buildScene(sceneDraws);
+
         // 0. create depth cubemap transformation matrices
         // -----------------------------------------------
         float near_plane = 1.0f;
         float far_plane = 25.0f;
         glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT, near_plane, far_plane);
         std::vector<glm::mat4> shadowTransforms;
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos[lightCounter], lightPos[lightCounter] + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+        shadowTransforms.push_back(shadowProj * glm::lookAt(light, light + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+
+        sceneDraws.CullShadowFaces(light, near_plane, far_plane);
+        sceneDraws.Upload(arena);
 
         // 1. render scene to depth cubemap
         // --------------------------------
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        simpleDepthShader.use();
-        for (unsigned int i = 0; i < 6; ++i)
-            simpleDepthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-        simpleDepthShader.setFloat("far_plane", far_plane);
-        simpleDepthShader.setVec3("lightPos", lightPos[lightCounter]);
-        renderScene(simpleDepthShader);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // 2. render scene as normal      -      
-        // -------------------------
+        {
+            TRACE_GPU_ZONE("depth pass");
+            glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+            glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            simpleDepthShader.use();
+            for (unsigned int i = 0; i < 6; ++i)
+                simpleDepthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+            simpleDepthShader.setFloat("far_plane", far_plane);
+            simpleDepthShader.setVec3("lightPos", light);
+            // shadows only end up in a pass sized view, so silhouettes are refined for that size and not the cubemap's,
+            // and with the looser shadow error
+            sceneDraws.DrawShadowFaces(arena, LodView(light, glm::radians(90.0f), (float)passSize.height, GEOMETRY_SHADOW_LOD_PIXEL_ERROR));
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
 
-        
+        if (sampleCameras)
+            cameraSampler.Begin(sceneSeed, proceduralScenes ? sceneSample : (uint64_t)(sceneCounter * 100 + lightCounter));
+
+        // layered: the light's views in batches, each batch one submission per pass into the layers of
+        // a texture array and one readback
+        // ------------------------------------------------------------------------------------------------
+        for (unsigned int first = 0; sampleCameras && layeredViews && first < viewsPerLight; first += LAYERED_MAX_VIEWS)
+        {
+            capture.lightPos = light;
+            auto renderStart = std::chrono::steady_clock::now();
+            unsigned int batch = std::min(viewsPerLight - first, (unsigned int)LAYERED_MAX_VIEWS);
+            glm::mat4 viewProjections[LAYERED_MAX_VIEWS];
+            glm::vec3 eyes[LAYERED_MAX_VIEWS], fronts[LAYERED_MAX_VIEWS];
+            LodView lodViews[LAYERED_MAX_VIEWS];
+            Frustum frusta[LAYERED_MAX_VIEWS];
+            for (unsigned int v = 0; v < batch; ++v)
+            {
+                cameraSampler.Next(camera, cameraSampleMode, sceneDraws, first + v, viewsPerLight);
+                glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), passAspect, 0.1f, 100.0f);
+                viewProjections[v] = projection * camera.GetViewMatrix();
+                eyes[v] = camera.Position;
+                fronts[v] = camera.Front;
+                lodViews[v] = LodView(camera.Position, glm::radians(camera.Zoom), (float)passSize.height);
+                frusta[v] = Frustum(viewProjections[v]);
+            }
+            layeredTarget.Resize(targetWidth, targetHeight, batch);
+            layeredTarget.SetViews(viewProjections, eyes, batch);
+            {
+                TRACE_GPU_ZONE("layered views");
+                glBindFramebuffer(GL_FRAMEBUFFER, layeredTarget.Framebuffer());
+                glViewport(0, 0, targetWidth, targetHeight);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                layeredShader.use();
+                layeredShader.setVec3("lightPos", light);
+                layeredShader.setFloat("far_plane", far_plane);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, woodTexture);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+                // hard shadows (pass 0) and pcss (pass 1) where the layout puts them in every layer
+                for (int pass = 0; pass < 2; ++pass)
+                {
+                    if (passes[pass].width == 0)
+                        continue;
+                    glViewport(passes[pass].x, passes[pass].y, passes[pass].width, passes[pass].height);
+                    layeredShader.setInt("shadows", pass == 0);
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, woodTexture);
+                    sceneDraws.DrawViews(arena, lodViews, frusta, batch);
+                }
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+            glFinish();
+            double renderMs = millisecondsSince(renderStart);
+            auto readbackStart = std::chrono::steady_clock::now();
+            {
+                TRACE_ZONE("readback");
+                layeredTarget.ReadBack(layeredPixels);
+            }
+            // the batch shares its render and readback time evenly
+            double readbackMs = millisecondsSince(readbackStart);
+            for (unsigned int v = 0; v < batch; ++v)
+            {
+                capture.cameraPos = eyes[v];
+                capture.cameraFront = fronts[v];
+                capture.renderMs = renderMs / batch;
+                capture.readbackMs = readbackMs / batch;
+                save_screenshot(&layeredPixels[(size_t)v * targetWidth * targetHeight * 3], targetWidth, targetHeight);
+            }
+        }
 
-        glViewport(0, 0, SCR_WIDTH / 2, SCR_HEIGHT);
-        shadows = true;
+        // otherwise every view of this light is drawn against the one depth cubemap in turn; sampled
+        // cameras capture each of them, the free camera draws one
+        // ------------------------------------------------------------------------------------------
+        unsigned int views = !sampleCameras ? 1 : layeredViews ? 0 : viewsPerLight;
+        capture.lightPos = light;
+        for (unsigned int v = 0; v < views; ++v)
+        {
+            auto renderStart = std::chrono::steady_clock::now();
+            if (sampleCameras)
+                cameraSampler.Next(camera, cameraSampleMode, sceneDraws, v, views);
+
+            LodView cameraLod(camera.Position, glm::radians(camera.Zoom), (float)passSize.height);
+            // both views share the camera, so one frustum culls them
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), passAspect, 0.1f, 100.0f);
+            glm::mat4 view = camera.GetViewMatrix();
+            Frustum cameraFrustum(projection * view);
+
+            // the capture target: the window, or the offscreen FBO
+            glBindFramebuffer(GL_FRAMEBUFFER, offscreen ? offscreenTarget.Framebuffer() : 0);
+            glViewport(0, 0, targetWidth, targetHeight);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            shader.use();
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+            // set lighting uniforms
+            shader.setVec3("lightPos", light);
+            shader.setVec3("viewPos", camera.Position);
+            shader.setFloat("far_plane", far_plane);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+
+            // 2. render scene as normal      -      
+            // -------------------------
+            if (passes[0].width > 0)
+            {
+                TRACE_GPU_ZONE("hard shadow pass");
+                const PassViewport& pass = passes[0];
+                glViewport(pass.x, pass.y, pass.width, pass.height);
+                shadows = true;
+                shader.setInt("shadows", shadows);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, woodTexture);
+                sceneDraws.Draw(arena, cameraLod, ARENA_STREAMS_ALL, &cameraFrustum);
+            }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        shader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / 2 / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        // set lighting uniforms
-        shader.setVec3("lightPos", lightPos[lightCounter]);
-        shader.setVec3("viewPos", camera.Position);
-        shader.setInt("shadows", shadows); // enable/disable shadows by pressing 'SPACE'
-        shader.setFloat("far_plane", far_plane);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-        renderScene(shader);
-
-        // 3. render scene as normal      -      
-        // -------------------------
-        
+            // 3. render scene as normal      -      
+            // -------------------------
+            if (passes[1].width > 0)
+            {
+                TRACE_GPU_ZONE("pcss pass");
+                const PassViewport& pass = passes[1];
+                glViewport(pass.x, pass.y, pass.width, pass.height);
+                shadows = false;
+                shader.setInt("shadows", shadows);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, woodTexture);
+                sceneDraws.Draw(arena, cameraLod, ARENA_STREAMS_ALL, &cameraFrustum);
+            }
 
-        glViewport(SCR_WIDTH / 2, 0, SCR_WIDTH / 2, SCR_HEIGHT);
-        //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        shadows = false;
-        shader.use();
-        shader.setInt("shadows", shadows);
-        /*
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / 2 / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        // set lighting uniforms
-        shader.setVec3("lightPos", lightPos);
-        shader.setVec3("viewPos", camera.Position);
-        shader.setInt("shadows", shadows); // enable/disable shadows by pressing 'SPACE'
-        shader.setFloat("far_plane", far_plane);
-        */
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-        renderScene(shader);
+            if (sampleCameras)
+            {
+                glFinish();
+                capture.renderMs = millisecondsSince(renderStart);
+                take_screenshot();
+            }
+        }
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!offscreen)
+        {
+            TRACE_ZONE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        TRACE_GPU_COLLECT();
     }
 
+    TextureStreamer::Get().Shutdown();
     glfwTerminate();
     return 0;
 }
 
-// renders the 3D scene
-// --------------------
-void renderScene(const Shader& shader)
+// records the 3D scene into a draw list; every pass then submits the same list
+// ----------------------------------------------------------------------------
+glm::vec3 buildScene(SceneDrawList& scene)
 {
+    GeometryLibrary& geometry = GeometryLibrary::Get();
+
+    if (proceduralScenes)
+        return sceneGenerator.Generate(sceneSeed, sceneSample, scene).light;
+
     if (sceneCounter == 1) {
-        shader.setBool("light", false);
+        unsigned int flags = 0;
 
         // room cube
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::scale(model, glm::vec3(10.0f));
-        shader.setMat4("model", model);
-        glDisable(GL_CULL_FACE); // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
-        shader.setInt("reverse_normals", 1); // A small little hack to invert normals when drawing cube from the inside so lighting still works.
-        renderCube();
-        shader.setInt("reverse_normals", 0); // and of course disable it
-        glEnable(GL_CULL_FACE);
+        flags |= DRAW_NO_CULL; // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
+        flags |= DRAW_REVERSE_NORMALS; // A small little hack to invert normals when drawing cube from the inside so lighting still works.
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
+        flags &= ~DRAW_REVERSE_NORMALS; // and of course disable it
+        flags &= ~DRAW_NO_CULL;
         // cubes
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f, -3.5f, 0.0));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(4.0f, 3.0f, 1.0));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-3.0f, -2.0f, 0.0));
         model = glm::rotate(model, glm::radians(30.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.5f, 1.0f, 3.5));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.5f, -2.0f, -4.0));
         model = glm::rotate(model, glm::radians(50.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
 
-        shader.setBool("light", true);
+        flags |= DRAW_LIGHT;
         model = glm::mat4(1.0f);
         model = glm::translate(model, lightPos[lightCounter]);
         model = glm::scale(model, glm::vec3(0.1f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
     }
     
     if (sceneCounter == 2) {               // ﰢ ߰
-        shader.setBool("light", false);
+        unsigned int flags = 0;
 
         // room cube
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::scale(model, glm::vec3(10.0f));
-        shader.setMat4("model", model);
-        glDisable(GL_CULL_FACE); // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
-        shader.setInt("reverse_normals", 1); // A small little hack to invert normals when drawing cube from the inside so lighting still works.
-        renderCube();
-        shader.setInt("reverse_normals", 0); // and of course disable it
-        glEnable(GL_CULL_FACE);
+        flags |= DRAW_NO_CULL; // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
+        flags |= DRAW_REVERSE_NORMALS; // A small little hack to invert normals when drawing cube from the inside so lighting still works.
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
+        flags &= ~DRAW_REVERSE_NORMALS; // and of course disable it
+        flags &= ~DRAW_NO_CULL;
         // cubes
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(5.0f, -5.0f, 0.0));
         model = glm::scale(model, glm::vec3(0.5f));
         model = glm::rotate(model, glm::radians(40.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(4.0f, 3.0f, 1.0));
         model = glm::scale(model, glm::vec3(0.1f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-3.0f, -2.0f, 0.0));
         model = glm::rotate(model, glm::radians(30.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.3f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(6.5f, 1.0f, 3.5));
         model = glm::scale(model, glm::vec3(0.6f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(1.5f, 2.0f, -1.0));
         model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(5.0f, 7.0f, -8.0));
         model = glm::rotate(model, glm::radians(20.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-4.5f, -9.0f, -4.0));
         model = glm::rotate(model, glm::radians(20.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.5f, 3.0f, -2.0));
         model = glm::rotate(model, glm::radians(20.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(2.0f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
 
 
         // ﰢ
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.5f, -1.0f, 1.0));     
-        shader.setMat4("model", model);
-        renderCone();
+        scene.Add(geometry.Mesh(PRIMITIVE_CONE), model, flags);
 
         
-        shader.setBool("another", false);
-        shader.setBool("light", true);
+        flags &= ~DRAW_ANOTHER;
+        flags |= DRAW_LIGHT;
         model = glm::mat4(1.0f);
         model = glm::translate(model, lightPos[lightCounter]);
         model = glm::scale(model, glm::vec3(0.1f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
     }
 
     if (sceneCounter == 3) {        //  ߰
-        shader.setBool("light", false);
+        unsigned int flags = 0;
 
         // room cube
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::scale(model, glm::vec3(10.0f));
-        shader.setMat4("model", model);
-        glDisable(GL_CULL_FACE); // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
-        shader.setInt("reverse_normals", 1); // A small little hack to invert normals when drawing cube from the inside so lighting still works.
-        renderCube();
-        shader.setInt("reverse_normals", 0); // and of course disable it
-        glEnable(GL_CULL_FACE);
+        flags |= DRAW_NO_CULL; // note that we disable culling here since we render 'inside' the cube instead of the usual 'outside' which throws off the normal culling methods.
+        flags |= DRAW_REVERSE_NORMALS; // A small little hack to invert normals when drawing cube from the inside so lighting still works.
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
+        flags &= ~DRAW_REVERSE_NORMALS; // and of course disable it
+        flags &= ~DRAW_NO_CULL;
         // cubes
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f, -3.5f, 0.0));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(4.0f, 3.0f, 1.0));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-3.0f, -2.0f, 0.0));
         model = glm::rotate(model, glm::radians(30.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.5f, 1.0f, 3.5));
         model = glm::scale(model, glm::vec3(0.5f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.5f, -2.0f, -4.0));
         model = glm::rotate(model, glm::radians(50.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
         model = glm::scale(model, glm::vec3(0.75f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
 
         // ü
 
-        shader.setBool("another", true);
+        flags |= DRAW_ANOTHER;
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, 0.0f, -3.0f));
-        shader.setMat4("model", model);
-        renderSphere();
+        scene.Add(geometry.Mesh(PRIMITIVE_SPHERE), model, flags);
 
 
-        shader.setBool("another", false);
-        shader.setBool("light", true);
+        flags &= ~DRAW_ANOTHER;
+        flags |= DRAW_LIGHT;
         model = glm::mat4(1.0f);
         model = glm::translate(model, lightPos[lightCounter]);
         model = glm::scale(model, glm::vec3(0.1f));
-        shader.setMat4("model", model);
-        renderCube();
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), model, flags);
     }
-}
 
-// renderCube() renders a 1x1 3D cube in NDC.
-// -------------------------------------------------
-unsigned int cubeVAO = 0;
-unsigned int cubeVBO = 0;
-void renderCube()
-{
-    // initialize (if necessary)
-    if (cubeVAO == 0)
-    {
-        float vertices[] = {
-            // back face
-            -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-             1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-             1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right         
-             1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-            -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-            -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
-            // front face
-            -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-             1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
-             1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-             1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-            -1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
-            -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-            // left face
-            -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-            -1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
-            -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-            -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-            -1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-            -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-            // right face
-             1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-             1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-             1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right         
-             1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-             1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-             1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left     
-            // bottom face
-            -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-             1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
-             1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-             1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-            -1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-            -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-            // top face
-            -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-             1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-             1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right     
-             1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-            -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-            -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
-        };
-        glGenVertexArrays(1, &cubeVAO);
-        glGenBuffers(1, &cubeVBO);
-        // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-        // link vertex attributes
-        glBindVertexArray(cubeVAO);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-    }
-    // render Cube
-    glBindVertexArray(cubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    return lightPos[lightCounter];
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -548,9 +732,17 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)   // ̽  ũ  ɷ  (Ʈ ̺Ʈ )
+    if (!sampleCameras && glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)   // ̽  ũ  ɷ  (Ʈ ̺Ʈ )
         take_screenshot();
 
+    if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS && !f12Pressed)     // F12 dumps the instrumentation recorded so far
+    {
+        Trace::Dump("trace.json");
+        f12Pressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_RELEASE)
+        f12Pressed = false;
+
     /*
 
     if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !gKeyPressed) // G Ű ,   ġ ٲ (Ʈ ݺ̺Ʈ )
@@ -604,43 +796,12 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
+// utility function for loading a 2D texture from file, shared through the global texture cache
+// ---------------------------------------------------------------------------------------------
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // for this tutorial: use GL_CLAMP_TO_EDGE for textures with alpha to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
+    return TextureCache::Get().Acquire(path, false, TEXTURE_WRAP_AUTO);
 }
 
 
@@ -650,388 +811,181 @@ unsigned int loadTexture(char const* path)
 void take_screenshot() {
 
     int width, height;
-    glfwGetFramebufferSize(glfwGetCurrentContext(), &width, &height);
-    int pixel_count = width * height * 3;
-
-    std::vector<unsigned char> pixels(pixel_count);
+    std::vector<unsigned char> pixels;
+    auto readbackStart = std::chrono::steady_clock::now();
+    if (offscreen) {
+        TRACE_ZONE("readback");
+        width = offscreenTarget.Width();
+        height = offscreenTarget.Height();
+        offscreenTarget.ReadBack(pixels);
+    }
+    else {
+        glfwGetFramebufferSize(glfwGetCurrentContext(), &width, &height);
+        int pixel_count = width * height * 3;
+        pixels.resize(pixel_count);
+
+        TRACE_ZONE("readback");
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+    capture.readbackMs = millisecondsSince(readbackStart);
+    capture.cameraPos = camera.Position;
+    capture.cameraFront = camera.Front;
+    save_screenshot(pixels.data(), width, height);
+}
 
-    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+// names, encodes and writes one captured image (bottom row first) and moves on to the next light or sample
+void save_screenshot(const unsigned char* pixels, int width, int height) {
 
     // Construct the file name with the current screenshotCounter value
     std::stringstream ss;
-    ss << "C:/Users/ppoo9/Desktop/data/test/" << sceneCounter << "_" << lightCounter << "_" << screenshotCounter << ".jpg";
+    if (proceduralScenes && sampleCameras)
+        ss << outputDirectory << sceneSeed << "_" << sceneSample << "_" << screenshotCounter << imageExtension(imageEncoder.format);
+    else if (proceduralScenes)
+        ss << outputDirectory << sceneSeed << "_" << sceneSample << imageExtension(imageEncoder.format);
+    else
+        ss << outputDirectory << sceneCounter << "_" << lightCounter << "_" << screenshotCounter << imageExtension(imageEncoder.format);
     std::string filename = ss.str();
 
+    capture.id = currentSampleId();
+    capture.seed = proceduralScenes ? sceneSeed : 0;
+    capture.sample = proceduralScenes ? sceneSample : 0;
+    capture.scene = proceduralScenes ? 0 : sceneCounter;
+    capture.light = proceduralScenes ? 0 : lightCounter;
+    capture.view = screenshotCounter - 1;
+    capture.file = filename;
+    capture.width = width;
+    capture.height = height;
+
     // Increment the screenshotCounter for the next screenshot
     screenshotCounter++;
 
-    // Save the screenshot as a JPG image
-    stbi_flip_vertically_on_write(1); // Flip the image vertically (OpenGL's origin is bottom-left)
-    stbi_write_jpg(filename.c_str(), width, height, 3, pixels.data(), 100); // Quality: 100 (highest)
-
-    std::cout << "Screenshot saved as " << filename << std::endl;
-    
-    if (screenshotCounter == 11) {
-        if (lightCounter == 10) exit(0);
-        lightCounter++;
-        screenshotCounter = 1;
-    }
+    if (publishFrames)
+        publish_frame(pixels, width, height);
 
-}
-
-
-unsigned int sphereVAO = 0;
-unsigned int sphereVBO = 0;
-const int sphereSlices = 30;
-const int sphereStacks = 30;
-
-void renderSphere() {
-    float radius = 1.0f;
-    if (sphereVAO == 0) {
-        glGenVertexArrays(1, &sphereVAO);
-        glGenBuffers(1, &sphereVBO);
-        glBindVertexArray(sphereVAO);
-
-        std::vector<float> vertices;
-        for (int stack = 0; stack <= sphereStacks; ++stack) {
-            float phi = static_cast<float>(M_PI) * stack / sphereStacks;
-            float phiNext = static_cast<float>(M_PI) * (stack + 1) / sphereStacks;
-
-            for (int slice = 0; slice <= sphereSlices; ++slice) {
-                float theta = static_cast<float>(2.0 * M_PI) * slice / sphereSlices;
-
-                // Calculate vertex positions
-                float x = radius * cos(theta) * sin(phi);
-                float y = radius * sin(theta) * sin(phi);
-                float z = radius * cos(phi);
-
-                // Calculate normals
-                float nx = cos(theta) * sin(phi);
-                float ny = sin(theta) * sin(phi);
-                float nz = cos(phi);
-
-                // Calculate texture coordinates
-                float s = static_cast<float>(slice) / sphereSlices;
-                float t = static_cast<float>(stack) / sphereStacks;
-
-                // Add the vertex data to the array
-                vertices.push_back(x);
-                vertices.push_back(y);
-                vertices.push_back(z);
-                vertices.push_back(nx);
-                vertices.push_back(ny);
-                vertices.push_back(nz);
-                vertices.push_back(s);
-                vertices.push_back(t);
+    // an earlier run finished this one already (we are redoing the rest of its capture)
+    if (saveImages && !manifest.Contains(capture.id)) {
+        if (encoderBenchmark) {
+            benchmarkEncoders(pixels, width, height);
+            encoderBenchmark = false;
+        }
+        // Encode the screenshot in memory first so encoding and disk I/O show up as separate zones
+        std::vector<unsigned char> encoded;
+        auto encodeStart = std::chrono::steady_clock::now();
+        {
+            TRACE_ZONE("encode");
+            if (!encodeImage(imageEncoder, pixels, width, height, encoded))
+                std::cout << "ERROR::SCREENSHOT::ENCODE_FAILED " << filename << std::endl;
+        }
+        capture.encodeMs = millisecondsSince(encodeStart);
+        // written under a temporary name and renamed, so a crash never leaves a truncated image behind
+        auto writeStart = std::chrono::steady_clock::now();
+        {
+            TRACE_ZONE("file write");
+            std::string temporary = filename + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary);
+                file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
             }
+            std::remove(filename.c_str());
+            std::rename(temporary.c_str(), filename.c_str());
         }
+        capture.writeMs = millisecondsSince(writeStart);
+        capture.bytes = encoded.size();
+        capture.shadows = shadowStats(pixels, width, height, captureLayout);
+        manifest.Append(capture);
 
-        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        // Vertex position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        // Normal (  꿡 ʿ )
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        // Texture coordinates ( )
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-
-        glBindVertexArray(0);
+        std::cout << "Screenshot saved as " << filename << std::endl;
     }
 
-    // Render the sphere
-    glBindVertexArray(sphereVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, (sphereSlices + 1) * (sphereStacks + 1) * 2);
-    glBindVertexArray(0);
-}
-
-
-
-
-unsigned int planeVAO = 0;
-unsigned int planeVBO = 0;
-
-void renderTriangle() {
-    if (planeVAO == 0) {
-        glGenVertexArrays(1, &planeVAO);
-        glGenBuffers(1, &planeVBO);
-
-        glBindVertexArray(planeVAO);
-
-        // Vertices of the triangle plane
-        float vertices[] = {
-            // Position           // Normal         // Texture coordinates
-            -0.5f, 0.0f, -0.5f,   0.0f, 1.0f, 0.0f,  0.0f, 0.0f,
-            0.5f, 0.0f, -0.5f,    0.0f, 1.0f, 0.0f,  1.0f, 0.0f,
-            0.0f, 0.0f, 0.5f,    0.0f, 1.0f, 0.0f,  0.0f, 1.0f
-        };
-
-        glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-        // Vertex position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        // Normal
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        // Texture coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-
-        glBindVertexArray(0);
+    // a light is done after all its sampled views, or ten free camera shots (one per procedural sample);
+    // the next one is this shard's next capture
+    if (screenshotCounter == shotsPerLight() + 1) {
+        screenshotCounter = 1;
+        if (proceduralScenes) {
+            // the next frame renders the next sample
+            sceneSample += shardCount;
+            if (sceneSample >= sceneSampleCount) exit(0);
+            return;
+        }
+        lightCounter += (int)shardCount;
+        if (lightCounter > 10) exit(0);
     }
 
-    // Render the triangle plane
-    glBindVertexArray(planeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-    glBindVertexArray(0);
 }
 
+// copies a screenshot into the frame ring, top row first, waiting for a free slot unless the ring overwrites
+void publish_frame(const unsigned char* pixels, int width, int height) {
 
-
-
-unsigned int coneVAO = 0;
-unsigned int coneVBO = 0;
-const int coneSegments = 30;
-const float coneHeight = 1.0f;
-const float coneRadius = 0.5f;
-
-void renderCone() {
-    if (coneVAO == 0) {
-        glGenVertexArrays(1, &coneVAO);
-        glGenBuffers(1, &coneVBO);
-
-        glBindVertexArray(coneVAO);
-
-        std::vector<float> vertices;
-
-        // Base circle
-        for (int i = 0; i < coneSegments; ++i) {
-            float theta = 2.0f * M_PI * static_cast<float>(i) / static_cast<float>(coneSegments);
-            float x = coneRadius * cos(theta);
-            float z = coneRadius * sin(theta);
-            float nx = 0.0f;
-            float ny = -1.0f;
-            float nz = 0.0f;
-            float s = x / coneRadius + 0.5f;
-            float t = z / coneRadius + 0.5f;
-
-            vertices.push_back(x);
-            vertices.push_back(-coneHeight / 2.0f);
-            vertices.push_back(z);
-            vertices.push_back(nx);
-            vertices.push_back(ny);
-            vertices.push_back(nz);
-            vertices.push_back(s);
-            vertices.push_back(t);
-        }
-
-        // Apex
-        vertices.push_back(0.0f);
-        vertices.push_back(coneHeight / 2.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.5f);
-        vertices.push_back(0.5f);
-
-        // Side triangles
-        for (int i = 0; i < coneSegments; ++i) {
-            int nextIndex = (i + 1) % coneSegments;
-
-            // Bottom vertex
-            vertices.push_back(vertices[i * 8]);
-            vertices.push_back(vertices[i * 8 + 1]);
-            vertices.push_back(vertices[i * 8 + 2]);
-            // Normal
-            vertices.push_back(vertices[i * 8]);
-            vertices.push_back(vertices[i * 8 + 1]);
-            vertices.push_back(vertices[i * 8 + 2]);
-            // Texture coordinates
-            vertices.push_back(0.5f + 0.5f * vertices[i * 8] / coneRadius);
-            vertices.push_back(0.5f + 0.5f * vertices[i * 8 + 2] / coneRadius);
-
-            // Top vertex
-            vertices.push_back(vertices[nextIndex * 8]);
-            vertices.push_back(vertices[nextIndex * 8 + 1]);
-            vertices.push_back(vertices[nextIndex * 8 + 2]);
-            // Normal
-            vertices.push_back(vertices[nextIndex * 8]);
-            vertices.push_back(vertices[nextIndex * 8 + 1]);
-            vertices.push_back(vertices[nextIndex * 8 + 2]);
-            // Texture coordinates
-            vertices.push_back(0.5f + 0.5f * vertices[nextIndex * 8] / coneRadius);
-            vertices.push_back(0.5f + 0.5f * vertices[nextIndex * 8 + 2] / coneRadius);
-
-            // Apex
-            vertices.push_back(0.0f);
-            vertices.push_back(coneHeight / 2.0f);
-            vertices.push_back(0.0f);
-            // Normal
-            vertices.push_back(0.0f);
-            vertices.push_back(1.0f);
-            vertices.push_back(0.0f);
-            // Texture coordinates
-            vertices.push_back(0.5f);
-            vertices.push_back(0.5f);
+    TRACE_ZONE("publish");
+    size_t rowBytes = (size_t)width * 3;
+    if (rowBytes * height > frameRing.header->slot_bytes) {
+        std::cout << "ERROR::FRAME_RING::FRAME_TOO_LARGE " << width << "x" << height << std::endl;
+        frame_ring_drop(&frameRing);
+        return;
+    }
+    unsigned char* slot;
+    while (!(slot = frame_ring_begin(&frameRing, ringOverwrite))) {
+        if (ringOverwrite) {
+            // the one slot it could take is being read right now
+            frame_ring_drop(&frameRing);
+            return;
         }
-
-        glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        // Vertex position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        // Normal
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        // Texture coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-
-        glBindVertexArray(0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-
-    // Render the cone
-    glBindVertexArray(coneVAO);
-    glDrawArrays(GL_TRIANGLES, 0, coneSegments * 3);
-    glBindVertexArray(0);
+    for (int y = 0; y < height; ++y)
+        std::memcpy(slot + (size_t)y * rowBytes, pixels + (size_t)(height - 1 - y) * rowBytes, rowBytes);
+    frame_ring_frame_info info;
+    info.sample_id = capture.id;
+    info.width = width;
+    info.height = height;
+    info.bytes = (uint32_t)(rowBytes * height);
+    frame_ring_commit(&frameRing, &info);
 }
 
+// screenshots per light (hand-written scenes) or per sample (procedural ones)
+int shotsPerLight()
+{
+    return sampleCameras ? (int)viewsPerLight : (proceduralScenes ? 1 : 10);
+}
 
+// procedural samples, or lights of the hand-written scene
+uint64_t captureCount()
+{
+    return proceduralScenes ? sceneSampleCount : 10;
+}
 
+// manifest id of the screenshot about to be saved: captures in order, shots in order within them
+uint64_t currentSampleId()
+{
+    uint64_t captureIndex = proceduralScenes ? sceneSample : (uint64_t)(lightCounter - 1);
+    return captureIndex * shotsPerLight() + (screenshotCounter - 1);
+}
 
-unsigned int triangularPrismVAO = 0;
-unsigned int triangularPrismVBO = 0;
-
-void renderTriangularPrism() {
-    if (triangularPrismVAO == 0) {
-        glGenVertexArrays(1, &triangularPrismVAO);
-        glGenBuffers(1, &triangularPrismVBO);
-
-        glBindVertexArray(triangularPrismVAO);
-
-        std::vector<float> vertices;
-
-        // Vertices of the triangular prism
-        float halfBaseWidth = 0.5f;
-        float halfBaseLength = 0.5f;
-        float height = 1.0f;
-
-        // Base triangle
-        vertices.push_back(-halfBaseWidth);  // Vertex 1
-        vertices.push_back(0.0f);
-        vertices.push_back(-halfBaseLength);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(-1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);  // Texture coordinates
-        vertices.push_back(0.5f);
-        vertices.push_back(0.5f);
-
-        vertices.push_back(halfBaseWidth);   // Vertex 2
-        vertices.push_back(0.0f);
-        vertices.push_back(-halfBaseLength);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(-1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);  // Texture coordinates
-        vertices.push_back(1.0f);
-        vertices.push_back(0.5f);
-
-        vertices.push_back(0.0f);            // Vertex 3 (Top of the base)
-        vertices.push_back(0.0f);
-        vertices.push_back(halfBaseLength);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(-1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.5f);  // Texture coordinates
-        vertices.push_back(0.5f);
-        vertices.push_back(0.0f);
-
-        // Top triangle
-        vertices.push_back(0.0f);            // Vertex 4 (Apex)
-        vertices.push_back(height);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.5f);  // Texture coordinates
-        vertices.push_back(0.5f);
-        vertices.push_back(0.5f);
-
-        vertices.push_back(-halfBaseWidth);  // Vertex 5
-        vertices.push_back(0.0f);
-        vertices.push_back(-halfBaseLength);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);  // Texture coordinates
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);
-
-        vertices.push_back(halfBaseWidth);   // Vertex 6
-        vertices.push_back(0.0f);
-        vertices.push_back(-halfBaseLength);
-        vertices.push_back(0.0f);  // Normal
-        vertices.push_back(1.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);  // Texture coordinates
-        vertices.push_back(1.0f);
-        vertices.push_back(1.0f);
-
-        // Side triangles
-        for (int i = 0; i < 3; ++i) {
-            int nextIndex = (i + 1) % 3;
-
-            // Bottom vertex
-            vertices.push_back(vertices[i * 9]);
-            vertices.push_back(vertices[i * 9 + 1]);
-            vertices.push_back(vertices[i * 9 + 2]);
-            // Normal
-            vertices.push_back(0.0f);
-            vertices.push_back(-1.0f);
-            vertices.push_back(0.0f);
-            // Texture coordinates
-            vertices.push_back(0.5f + vertices[i * 9] / halfBaseWidth * 0.5f);
-            vertices.push_back(0.5f + vertices[i * 9 + 2] / halfBaseLength * 0.5f);
-
-            // Top vertex
-            vertices.push_back(vertices[nextIndex * 9 + 3]);  // Reuse the apex vertex coordinates
-            vertices.push_back(vertices[nextIndex * 9 + 4]);
-            vertices.push_back(vertices[nextIndex * 9 + 5]);
-            // Normal
-            vertices.push_back(0.0f);
-            vertices.push_back(1.0f);
-            vertices.push_back(0.0f);
-            // Texture coordinates
-            vertices.push_back(0.5f);
-            vertices.push_back(0.5f);
-        }
-
-        glBindBuffer(GL_ARRAY_BUFFER, triangularPrismVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        // Vertex position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
-        // Normal
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
-        // Texture coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(6 * sizeof(float)));
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-        glBindVertexArray(0);
-    }
+std::string manifestPath(const std::string& directory)
+{
+    std::stringstream path;
+    if (proceduralScenes)
+        path << directory << "manifest_" << sceneSeed << ".jsonl";
+    else
+        path << directory << "manifest_scene" << sceneCounter << ".jsonl";
+    return path.str();
+}
 
-    // Render the triangular prism
-    glBindVertexArray(triangularPrismVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 15);
-    glBindVertexArray(0);
+// --launch: one worker per shard, each with its own manifest, merged into OUTPUT_DIR's when all are done
+int launchShards(const char* argv0, unsigned int count)
+{
+    ShardLaunch launch;
+    launch.executable = currentExecutable(argv0);
+    for (unsigned int shard = 0; shard < count; ++shard)
+        launch.manifests.push_back(manifestPath(std::string(OUTPUT_DIR) + "shard" + std::to_string(shard) + "/"));
+    launch.expected = (size_t)(captureCount() * shotsPerLight());
+    launch.merged = manifestPath(OUTPUT_DIR);
+    return runShardLauncher(launch);
 }
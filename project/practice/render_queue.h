@@ -0,0 +1,184 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Sorting and submission helpers for draw packets. Every packet carries a 64 bit key whose fields
+// are ordered by how expensive the state they select is to change, most significant first:
+//
+//   pass 4 | program 8 | cull 1 | material 16 | vertex array 8 | depth 27
+//
+// so a sorted list switches programs least and vertex arrays most, and draws sharing all state
+// come out front to back. Program, material and vertex array fields hold dense indices handed
+// out by a SortKeyTable, not GL names.
+
+#define SORT_KEY_DEPTH_BITS    27
+#define SORT_KEY_ARRAY_BITS    8
+#define SORT_KEY_MATERIAL_BITS 16
+#define SORT_KEY_CULL_BITS     1
+#define SORT_KEY_PROGRAM_BITS  8
+#define SORT_KEY_PASS_BITS     4
+
+#define SORT_KEY_ARRAY_SHIFT    SORT_KEY_DEPTH_BITS
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_ARRAY_SHIFT + SORT_KEY_ARRAY_BITS)
+#define SORT_KEY_CULL_SHIFT     (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+#define SORT_KEY_PROGRAM_SHIFT  (SORT_KEY_CULL_SHIFT + SORT_KEY_CULL_BITS)
+#define SORT_KEY_PASS_SHIFT     (SORT_KEY_PROGRAM_SHIFT + SORT_KEY_PROGRAM_BITS)
+
+inline uint64_t sortKeyField(unsigned int value, int bits, int shift)
+{
+    uint64_t mask = (1ull << bits) - 1;
+    return (std::min<uint64_t>(value, mask)) << shift;
+}
+
+// a distance >= 0 as an order preserving integer of SORT_KEY_DEPTH_BITS bits (the float's top bits)
+inline uint32_t sortKeyDepth(float distance)
+{
+    if (!(distance > 0.0f))
+        return 0;
+    uint32_t bits;
+    std::memcpy(&bits, &distance, sizeof(bits));
+    return bits >> (31 - SORT_KEY_DEPTH_BITS);
+}
+
+inline uint64_t makeSortKey(unsigned int pass, unsigned int program, bool noCull, unsigned int material, unsigned int vertexArray, uint32_t depth)
+{
+    return sortKeyField(pass, SORT_KEY_PASS_BITS, SORT_KEY_PASS_SHIFT) |
+           sortKeyField(program, SORT_KEY_PROGRAM_BITS, SORT_KEY_PROGRAM_SHIFT) |
+           sortKeyField(noCull ? 1 : 0, SORT_KEY_CULL_BITS, SORT_KEY_CULL_SHIFT) |
+           sortKeyField(material, SORT_KEY_MATERIAL_BITS, SORT_KEY_MATERIAL_SHIFT) |
+           sortKeyField(vertexArray, SORT_KEY_ARRAY_BITS, SORT_KEY_ARRAY_SHIFT) |
+           (uint64_t)(depth & ((1u << SORT_KEY_DEPTH_BITS) - 1));
+}
+
+// the key without its depth: packets with equal state keys can go into one multi draw
+inline uint64_t sortKeyState(uint64_t key) { return key >> SORT_KEY_DEPTH_BITS; }
+inline bool sortKeyNoCull(uint64_t key) { return ((key >> SORT_KEY_CULL_SHIFT) & 1) != 0; }
+
+// GL names -> dense key indices, in first use order; 0 stays 0 ("none")
+class SortKeyTable
+{
+public:
+    unsigned int Index(unsigned int name)
+    {
+        if (name == 0)
+            return 0;
+        auto found = indices.find(name);
+        if (found != indices.end())
+            return found->second;
+        unsigned int index = (unsigned int)indices.size() + 1;
+        indices[name] = index;
+        return index;
+    }
+
+    void Clear() { indices.clear(); }
+
+private:
+    std::unordered_map<unsigned int, unsigned int> indices;
+};
+
+struct SortPacket {
+    uint64_t key;
+    uint32_t index;     // the packet's draw in the owner's arrays
+};
+
+// stable LSD radix sort on the keys, 8 bits a pass; bytes that are the same in every key
+// (unused fields, a single program) are skipped
+inline void radixSortPackets(std::vector<SortPacket>& packets, std::vector<SortPacket>& scratch)
+{
+    size_t count = packets.size();
+    if (count < 2)
+        return;
+    size_t histogram[8][256];
+    std::memset(histogram, 0, sizeof(histogram));
+    for (const SortPacket& packet : packets)
+        for (int byte = 0; byte < 8; ++byte)
+            ++histogram[byte][(packet.key >> (byte * 8)) & 0xff];
+
+    scratch.resize(count);
+    SortPacket* src = packets.data();
+    SortPacket* dst = scratch.data();
+    for (int byte = 0; byte < 8; ++byte)
+    {
+        size_t* buckets = histogram[byte];
+        if (buckets[(src[0].key >> (byte * 8)) & 0xff] == count)
+            continue;
+        size_t offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            size_t n = buckets[b];
+            buckets[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i)
+            dst[buckets[(src[i].key >> (byte * 8)) & 0xff]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != packets.data())
+        std::memcpy(packets.data(), src, count * sizeof(SortPacket));
+}
+
+// last state set through it, so consecutive packets only change what differs. Starts from the
+// defaults the render loop keeps between passes (culling on, nothing else known).
+class RenderStateCache
+{
+public:
+    void Reset()
+    {
+        program = ~0u;
+        vertexArray = ~0u;
+        texture = ~0u;
+        cullEnabled = true;
+    }
+
+    RenderStateCache() { Reset(); }
+
+    void UseProgram(unsigned int id)
+    {
+        if (id == program)
+            return;
+        glUseProgram(id);
+        program = id;
+    }
+
+    void SetCulling(bool enabled)
+    {
+        if (enabled == cullEnabled)
+            return;
+        if (enabled)
+            glEnable(GL_CULL_FACE);
+        else
+            glDisable(GL_CULL_FACE);
+        cullEnabled = enabled;
+    }
+
+    void BindVertexArray(unsigned int id)
+    {
+        if (id == vertexArray)
+            return;
+        glBindVertexArray(id);
+        vertexArray = id;
+    }
+
+    // the material texture lives on unit 0
+    void BindTexture(unsigned int id)
+    {
+        if (id == texture)
+            return;
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, id);
+        texture = id;
+    }
+
+private:
+    unsigned int program, vertexArray, texture;
+    bool cullEnabled;
+};
+
+#endif
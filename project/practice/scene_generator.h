@@ -0,0 +1,265 @@
+#ifndef SCENE_GENERATOR_H
+#define SCENE_GENERATOR_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "geometry_arena.h"
+#include "draw_list.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Seeded procedural scenes for the dataset: (seed, sample) always gives the same room with a
+// random set of primitives and model instances that don't intersect, random sizes, rotations and
+// materials, and a light that isn't inside anything. Objects are placed by rejection sampling
+// their bounding spheres against the ones placed before, into a fixed size array, and every draw
+// goes straight into the SceneDrawList, whose vectors keep their capacity across Clear - after
+// the first few samples generating a scene allocates nothing.
+
+#define SCENE_MAX_OBJECTS 32
+#define SCENE_ROOM_HALF_EXTENT 10.0f    // the room cube is the 2x2x2 cube scaled by 10
+
+// splitmix64 (Steele et al.): one 64 bit state, every seed is a good seed, and (seed, sample)
+// pairs can be mixed into a starting state without any warm up
+class SceneRandom
+{
+public:
+    explicit SceneRandom(uint64_t seed) : state(seed) {}
+    SceneRandom(uint64_t seed, uint64_t sample) : state(seed)
+    {
+        state = Next() ^ sample;
+        state = Next();
+    }
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // [0, 1)
+    float Uniform() { return (float)(Next() >> 40) * (1.0f / 16777216.0f); }
+    float Uniform(float lo, float hi) { return lo + (hi - lo) * Uniform(); }
+    // [0, count)
+    unsigned int Below(unsigned int count) { return (unsigned int)(((Next() >> 32) * count) >> 32); }
+    bool Chance(float probability) { return Uniform() < probability; }
+
+    glm::vec3 InBox(const glm::vec3& lo, const glm::vec3& hi)
+    {
+        return glm::vec3(Uniform(lo.x, hi.x), Uniform(lo.y, hi.y), Uniform(lo.z, hi.z));
+    }
+
+    glm::vec3 UnitVector()
+    {
+        float z = Uniform(-1.0f, 1.0f);
+        float phi = Uniform(0.0f, 6.2831853f);
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+private:
+    uint64_t state;
+};
+
+struct SceneGeneratorSettings {
+    unsigned int minObjects = 4;
+    unsigned int maxObjects = 14;           // at most SCENE_MAX_OBJECTS
+    float minRadius = 0.4f;                 // world space bounding sphere radius of an object
+    float maxRadius = 2.5f;
+    float maxStretch = 2.0f;                // per axis scale of primitives relative to the smallest one
+    float gap = 0.2f;                       // free space between objects, and between objects and walls
+    float lightClearance = 1.0f;            // free space around the light
+    float anotherChance = 0.25f;            // flat purple (DRAW_ANOTHER) instead of a texture
+    float modelChance = 0.3f;               // an object is a model instance, when models were added
+    unsigned int attempts = 24;             // placement tries per object before it is given up
+};
+
+// what a sample ended up with; the spheres are the placed objects (not the room or the light)
+struct GeneratedScene {
+    glm::vec3 light = glm::vec3(0.0f);
+    unsigned int objectCount = 0;
+    glm::vec4 objects[SCENE_MAX_OBJECTS];
+};
+
+class SceneGenerator
+{
+public:
+    SceneGeneratorSettings settings;
+
+    // diffuse textures objects and walls pick from; 0 is the texture the pass binds
+    void AddMaterial(unsigned int texture) { materials.push_back(texture); }
+
+    // registers a Model loaded into the geometry arena as something to instance; its meshes keep
+    // their own diffuse textures. The model has to outlive the generator.
+    template <class M>
+    void AddModel(const M& model)
+    {
+        Prototype prototype;
+        prototype.firstPart = (unsigned int)parts.size();
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            if (!model.meshes[i].arena)
+                continue;
+            Part part{ &model.meshes[i].arenaMesh, 0 };
+            for (unsigned int t = 0; t < model.meshes[i].textures.size() && part.material == 0; t++)
+                if (model.meshes[i].textures[t].type == "texture_diffuse")
+                    part.material = model.meshes[i].textures[t].id;
+            parts.push_back(part);
+        }
+        prototype.partCount = (unsigned int)parts.size() - prototype.firstPart;
+        prototype.center = (model.boundsMin + model.boundsMax) * 0.5f;
+        prototype.radius = glm::length(model.boundsMax - model.boundsMin) * 0.5f;
+        prototype.stretch = false;
+        if (prototype.partCount > 0 && prototype.radius > 0.0f)
+            models.push_back(prototype);
+        else
+            parts.resize(prototype.firstPart);
+    }
+
+    // records the room, the objects and the light marker of one sample into scene (which the
+    // caller has cleared)
+    GeneratedScene Generate(uint64_t seed, uint64_t sample, SceneDrawList& scene)
+    {
+        TRACE_ZONE("generate scene");
+        preparePrimitives();
+        SceneRandom random(seed, sample);
+        GeneratedScene result;
+        GeometryLibrary& geometry = GeometryLibrary::Get();
+
+        // room cube, drawn from the inside
+        glm::mat4 room = glm::scale(glm::mat4(1.0f), glm::vec3(SCENE_ROOM_HALF_EXTENT));
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), room, DRAW_NO_CULL | DRAW_REVERSE_NORMALS, pickMaterial(random));
+
+        unsigned int maxObjects = std::min(settings.maxObjects, (unsigned int)SCENE_MAX_OBJECTS);
+        unsigned int minObjects = std::min(settings.minObjects, maxObjects);
+        unsigned int wanted = minObjects + random.Below(maxObjects - minObjects + 1);
+        for (unsigned int n = 0; n < wanted; ++n)
+        {
+            const Prototype& prototype = !models.empty() && random.Chance(settings.modelChance)
+                ? models[random.Below((unsigned int)models.size())]
+                : primitives[random.Below(PRIMITIVE_COUNT)];
+
+            // size first so the position can keep the whole sphere inside the room
+            float radius = random.Uniform(settings.minRadius, settings.maxRadius);
+            glm::vec3 stretch(1.0f);
+            if (prototype.stretch)
+            {
+                stretch = glm::vec3(random.Uniform(1.0f, settings.maxStretch), random.Uniform(1.0f, settings.maxStretch), random.Uniform(1.0f, settings.maxStretch));
+                stretch = stretch * (1.0f / std::max(stretch.x, std::max(stretch.y, stretch.z)));
+            }
+            glm::vec3 scale = stretch * (radius / prototype.radius);
+            glm::vec3 axis = random.UnitVector();
+            float angle = random.Uniform(0.0f, 6.2831853f);
+
+            glm::vec3 center;
+            bool placed = false;
+            for (unsigned int attempt = 0; attempt < settings.attempts && !placed; ++attempt)
+            {
+                float inner = SCENE_ROOM_HALF_EXTENT - radius - settings.gap;
+                if (inner <= 0.0f)
+                    break;
+                center = random.InBox(glm::vec3(-inner), glm::vec3(inner));
+                placed = fits(result, center, radius, settings.gap);
+            }
+            if (!placed)
+                continue;
+
+            // the prototype's own center goes to the picked one
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), center);
+            model = glm::rotate(model, angle, axis);
+            model = glm::scale(model, scale);
+            model = glm::translate(model, -prototype.center);
+
+            unsigned int flags = random.Chance(settings.anotherChance) ? DRAW_ANOTHER : 0;
+            if (prototype.twoSided)
+                flags |= DRAW_NO_CULL;
+            if (prototype.firstPart == ~0u)
+                scene.Add(*prototype.mesh, model, flags, pickMaterial(random));
+            else
+                for (unsigned int p = 0; p < prototype.partCount; ++p)
+                    scene.Add(*parts[prototype.firstPart + p].mesh, model, flags, parts[prototype.firstPart + p].material);
+            result.objects[result.objectCount++] = glm::vec4(center, radius);
+        }
+
+        // light: anywhere in the room that is clear of the objects, the middle of the room if
+        // nothing is (it can always see something from there)
+        result.light = glm::vec3(0.0f);
+        float inner = SCENE_ROOM_HALF_EXTENT - settings.lightClearance;
+        for (unsigned int attempt = 0; attempt < settings.attempts * 4; ++attempt)
+        {
+            glm::vec3 light = random.InBox(glm::vec3(-inner), glm::vec3(inner));
+            if (fits(result, light, 0.0f, settings.lightClearance))
+            {
+                result.light = light;
+                break;
+            }
+        }
+        glm::mat4 marker = glm::translate(glm::mat4(1.0f), result.light);
+        marker = glm::scale(marker, glm::vec3(0.1f));
+        scene.Add(geometry.Mesh(PRIMITIVE_CUBE), marker, DRAW_LIGHT);
+        return result;
+    }
+
+private:
+    struct Part {
+        const ArenaMesh* mesh;
+        unsigned int material;
+    };
+    // something that can be placed: one primitive mesh (firstPart ~0u) or a model's meshes
+    struct Prototype {
+        const ArenaMesh* mesh = nullptr;
+        unsigned int firstPart = ~0u, partCount = 1;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 1.0f;
+        bool stretch = true;    // primitives take a non-uniform scale, models keep their proportions
+        bool twoSided = false;  // open surfaces (the lone triangle) are seen from both sides
+    };
+
+    Prototype primitives[PRIMITIVE_COUNT];
+    bool primitivesReady = false;
+    std::vector<Prototype> models;
+    std::vector<Part> parts;
+    std::vector<unsigned int> materials;
+
+    void preparePrimitives()
+    {
+        if (primitivesReady)
+            return;
+        GeometryLibrary& geometry = GeometryLibrary::Get();
+        for (int p = 0; p < PRIMITIVE_COUNT; ++p)
+        {
+            const ArenaMesh& mesh = geometry.Mesh((Primitive)p);
+            primitives[p].mesh = &mesh;
+            primitives[p].center = mesh.center;
+            primitives[p].radius = mesh.radius > 0.0f ? mesh.radius : 1.0f;
+            primitives[p].twoSided = p == PRIMITIVE_TRIANGLE;
+        }
+        primitivesReady = true;
+    }
+
+    unsigned int pickMaterial(SceneRandom& random) const
+    {
+        return materials.empty() ? 0 : materials[random.Below((unsigned int)materials.size())];
+    }
+
+    // sphere (center, radius) keeps gap to every object placed so far
+    static bool fits(const GeneratedScene& scene, const glm::vec3& center, float radius, float gap)
+    {
+        for (unsigned int i = 0; i < scene.objectCount; ++i)
+        {
+            glm::vec3 d = glm::vec3(scene.objects[i]) - center;
+            float reach = scene.objects[i].w + radius + gap;
+            if (glm::dot(d, d) < reach * reach)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
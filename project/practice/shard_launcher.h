@@ -0,0 +1,253 @@
+#ifndef SHARD_LAUNCHER_H
+#define SHARD_LAUNCHER_H
+
+#include "manifest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Generation spread over worker processes on one machine. Each worker (--shard i/N) gets its own
+// context and renders every Nth capture into its own directory with its own manifest; the
+// launcher (--launch N) starts them, reports their progress from those manifests, restarts a
+// worker that dies (it resumes from its manifest) and finally merges the manifests into one index.
+
+#define SHARD_MAX_RESTARTS 5        // per worker, then the launcher gives up on it
+#define SHARD_POLL_MILLISECONDS 500
+#define SHARD_REPORT_SECONDS 10
+
+#define WORKER_RUNNING -1
+
+// "i/N" with i < N
+inline bool parseShard(const char* text, unsigned int& index, unsigned int& count)
+{
+    return std::sscanf(text, "%u/%u", &index, &count) == 2 && count > 0 && index < count;
+}
+
+inline void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// path workers are started from: argv[0] isn't always one CreateProcess or execv accept
+inline std::string currentExecutable(const char* argv0)
+{
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+    if (length > 0 && length < MAX_PATH)
+        return std::string(path, length);
+#else
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+    if (length > 0 && length < (ssize_t)sizeof(path))
+        return std::string(path, (size_t)length);
+#endif
+    return argv0;
+}
+
+class WorkerProcess
+{
+public:
+    WorkerProcess() {}
+    WorkerProcess(const WorkerProcess&) = delete;
+    WorkerProcess& operator=(const WorkerProcess&) = delete;
+    WorkerProcess(WorkerProcess&& other) { *this = std::move(other); }
+    WorkerProcess& operator=(WorkerProcess&& other)
+    {
+        std::swap(handle, other.handle);
+        std::swap(running, other.running);
+        return *this;
+    }
+    ~WorkerProcess() { Kill(); }
+
+    bool Start(const std::string& executable, const std::vector<std::string>& arguments)
+    {
+#ifdef _WIN32
+        std::string commandLine = "\"" + executable + "\"";
+        for (const std::string& argument : arguments)
+            commandLine += " \"" + argument + "\"";
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        PROCESS_INFORMATION process = {};
+        if (!CreateProcessA(executable.c_str(), &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process))
+        {
+            std::cout << "ERROR::SHARD::START_FAILED " << commandLine << std::endl;
+            return false;
+        }
+        CloseHandle(process.hThread);
+        handle = process.hProcess;
+#else
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(executable.c_str()));
+        for (const std::string& argument : arguments)
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        argv.push_back(nullptr);
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::cout << "ERROR::SHARD::START_FAILED " << executable << std::endl;
+            return false;
+        }
+        if (pid == 0)
+        {
+            execv(executable.c_str(), argv.data());
+            _exit(127);
+        }
+        handle = pid;
+#endif
+        running = true;
+        return true;
+    }
+
+    // WORKER_RUNNING, or the exit code once it has ended (killed by a signal: 128 + signal)
+    int Poll()
+    {
+        if (!running)
+            return 0;
+#ifdef _WIN32
+        if (WaitForSingleObject(handle, 0) != WAIT_OBJECT_0)
+            return WORKER_RUNNING;
+        DWORD code = 1;
+        GetExitCodeProcess(handle, &code);
+        CloseHandle(handle);
+        handle = NULL;
+        running = false;
+        return (int)code;
+#else
+        int status = 0;
+        if (waitpid(handle, &status, WNOHANG) != handle)
+            return WORKER_RUNNING;
+        running = false;
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#endif
+    }
+
+    void Kill()
+    {
+        if (!running)
+            return;
+#ifdef _WIN32
+        TerminateProcess(handle, 1);
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+        handle = NULL;
+#else
+        kill(handle, SIGTERM);
+        waitpid(handle, nullptr, 0);
+#endif
+        running = false;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = NULL;
+#else
+    pid_t handle = 0;
+#endif
+    bool running = false;
+};
+
+struct ShardLaunch {
+    std::string executable;             // this program; workers get --shard i/N appended
+    std::vector<std::string> arguments; // passed on to every worker before it
+    std::vector<std::string> manifests; // the manifest each worker writes, by shard
+    size_t expected = 0;                // records when every shard is done
+    std::string merged;                 // index the shard manifests are merged into
+};
+
+// runs the workers to completion; 0 when every shard finished and the merge succeeded
+inline int runShardLauncher(const ShardLaunch& launch)
+{
+    unsigned int shards = (unsigned int)launch.manifests.size();
+    std::vector<WorkerProcess> workers(shards);
+    std::vector<unsigned int> restarts(shards, 0);
+    std::vector<bool> finished(shards, false);
+    auto start = [&](unsigned int shard) {
+        std::vector<std::string> arguments = launch.arguments;
+        arguments.push_back("--shard");
+        arguments.push_back(std::to_string(shard) + "/" + std::to_string(shards));
+        return workers[shard].Start(launch.executable, arguments);
+    };
+    bool failed = false;
+    for (unsigned int shard = 0; shard < shards; ++shard)
+        if (!start(shard))
+            finished[shard] = failed = true;
+
+    auto began = std::chrono::steady_clock::now(), reported = began;
+    for (unsigned int remaining = shards; remaining > 0;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SHARD_POLL_MILLISECONDS));
+        remaining = 0;
+        for (unsigned int shard = 0; shard < shards; ++shard)
+        {
+            if (finished[shard])
+                continue;
+            int code = workers[shard].Poll();
+            if (code == WORKER_RUNNING)
+            {
+                ++remaining;
+                continue;
+            }
+            if (code == 0)
+            {
+                finished[shard] = true;
+                continue;
+            }
+            // a crashed worker picks up where its manifest ends
+            if (restarts[shard]++ < SHARD_MAX_RESTARTS && start(shard))
+            {
+                std::cout << "shard " << shard << " exited with " << code << ", restart " << restarts[shard] << std::endl;
+                ++remaining;
+                continue;
+            }
+            std::cout << "ERROR::SHARD::GAVE_UP shard " << shard << " (exit code " << code << ")" << std::endl;
+            finished[shard] = true;
+            failed = true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (remaining == 0 || now - reported >= std::chrono::seconds(SHARD_REPORT_SECONDS))
+        {
+            reported = now;
+            size_t done = 0;
+            for (const std::string& manifest : launch.manifests)
+                done += countManifestRecords(manifest);
+            double seconds = std::chrono::duration<double>(now - began).count();
+            std::cout << "shards: " << done << "/" << launch.expected << " samples, " << remaining << " workers running, "
+                << (seconds > 0.0 ? done / seconds : 0.0) << " samples/s" << std::endl;
+        }
+    }
+
+    if (!mergeManifests(launch.manifests, launch.merged))
+        return 1;
+    std::cout << "merged " << countManifestRecords(launch.merged) << " records into " << launch.merged << std::endl;
+    return failed ? 1 : 0;
+}
+
+#endif
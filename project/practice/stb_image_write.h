@@ -33,6 +33,9 @@ BUILDING:
    unsigned char * my_compress(unsigned char *data, int data_len, int *out_len, int quality);
    The returned data will be freed with STBIW_FREE() (free() by default),
    so it must be heap allocated with STBIW_MALLOC() (malloc() by default),
+   The JPEG writer transforms several blocks at once with SSE2 (4 blocks) or
+   AVX2 (8 blocks) when the compiler targets them; #define STBIW_NO_SIMD to
+   always use the scalar code.
 
 UNICODE:
 
@@ -112,6 +115,13 @@ USAGE:
    Higher quality looks better but results in a bigger image.
    JPEG baseline (no JPEG progressive).
 
+   stbi_write_jpg_striped_to_func splits the image into up to 'stripes'
+   horizontal bands of whole MCU rows, each its own restart interval, and
+   hands their encoding to 'parallel' (run in order on the calling thread
+   when it is NULL). Every band starts with fresh DC predictions, so they
+   encode independently; the file is an ordinary baseline JPEG with a DRI
+   segment and RSTn markers between the bands.
+
 CREDITS:
 
 
@@ -194,6 +204,11 @@ STBIWDEF int stbi_write_tga_to_func(stbi_write_func* func, void* context, int w,
 STBIWDEF int stbi_write_hdr_to_func(stbi_write_func* func, void* context, int w, int h, int comp, const float* data);
 STBIWDEF int stbi_write_jpg_to_func(stbi_write_func* func, void* context, int x, int y, int comp, const void* data, int quality);
 
+// runs job(job_context, i) for every i in [0, count), on as many threads as it likes; returns when all are done
+typedef void stbi_write_parallel_func(void* context, int count, void (*job)(void* job_context, int index), void* job_context);
+STBIWDEF int stbi_write_jpg_striped_to_func(stbi_write_func* func, void* context, int x, int y, int comp, const void* data, int quality,
+    int stripes, stbi_write_parallel_func* parallel, void* parallel_context);
+
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #endif//INCLUDE_STB_IMAGE_WRITE_H
@@ -249,6 +264,46 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #define STBIW_UCHAR(x) (unsigned char) ((x) & 0xff)
 
+// Vector path of the JPEG writer: one block per lane, so the scalar color conversion, DCT and
+// quantization run unchanged on STBIW__JPG_LANES blocks at a time, in the same operation order.
+// Its output is then bit-identical to the scalar writer's as long as neither is compiled with
+// floating point contraction (MSVC's /fp:precise, GCC and Clang with -ffp-contract=off); when the
+// compiler fuses multiply-adds (e.g. -march with FMA and GCC's default -ffp-contract=fast) a
+// quantized coefficient can differ by one step.
+#if !defined(STBIW_NO_SIMD)
+#if defined(__AVX2__)
+#define STBIW__JPG_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STBIW__JPG_SSE2
+#endif
+#endif
+
+#if defined(STBIW__JPG_AVX2)
+#include <immintrin.h>
+#define STBIW__JPG_LANES 8
+typedef __m256 stbiw__vf;
+#define stbiw__vadd(a,b) _mm256_add_ps(a,b)
+#define stbiw__vsub(a,b) _mm256_sub_ps(a,b)
+#define stbiw__vmul(a,b) _mm256_mul_ps(a,b)
+#define stbiw__vand(a,b) _mm256_and_ps(a,b)
+#define stbiw__vor(a,b) _mm256_or_ps(a,b)
+#define stbiw__vset1(a) _mm256_set1_ps(a)
+#define stbiw__vload(p) _mm256_loadu_ps(p)
+#define stbiw__vtrunc_store(p,a) _mm256_storeu_si256((__m256i*)(p), _mm256_cvttps_epi32(a))
+#elif defined(STBIW__JPG_SSE2)
+#include <emmintrin.h>
+#define STBIW__JPG_LANES 4
+typedef __m128 stbiw__vf;
+#define stbiw__vadd(a,b) _mm_add_ps(a,b)
+#define stbiw__vsub(a,b) _mm_sub_ps(a,b)
+#define stbiw__vmul(a,b) _mm_mul_ps(a,b)
+#define stbiw__vand(a,b) _mm_and_ps(a,b)
+#define stbiw__vor(a,b) _mm_or_ps(a,b)
+#define stbiw__vset1(a) _mm_set1_ps(a)
+#define stbiw__vload(p) _mm_loadu_ps(p)
+#define stbiw__vtrunc_store(p,a) _mm_storeu_si128((__m128i*)(p), _mm_cvttps_epi32(a))
+#endif
+
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_png_compression_level = 8;
 static int stbi_write_tga_with_rle = 1;
@@ -1285,6 +1340,7 @@ static void stbiw__jpg_writeBits(stbi__write_context* s, int* bitBufP, int* bitC
     *bitCntP = bitCnt;
 }
 
+#ifndef STBIW__JPG_LANES
 static void stbiw__jpg_DCT(float* d0p, float* d1p, float* d2p, float* d3p, float* d4p, float* d5p, float* d6p, float* d7p) {
     float d0 = *d0p, d1 = *d1p, d2 = *d2p, d3 = *d3p, d4 = *d4p, d5 = *d5p, d6 = *d6p, d7 = *d7p;
     float z1, z2, z3, z4, z5, z11, z13;
@@ -1332,6 +1388,7 @@ static void stbiw__jpg_DCT(float* d0p, float* d1p, float* d2p, float* d3p, float
 
     *d0p = d0;  *d2p = d2;  *d4p = d4;  *d6p = d6;
 }
+#endif
 
 static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
     int tmp1 = val < 0 ? -val : val;
@@ -1343,10 +1400,11 @@ static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
     bits[0] = val & ((1 << bits[1]) - 1);
 }
 
-static int stbiw__jpg_processDU(stbi__write_context* s, int* bitBuf, int* bitCnt, float* CDU, int du_stride, float* fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
-    const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
-    const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
-    int dataOff, i, j, n, diff, end0pos, x, y;
+static int stbiw__jpg_encodeDU(stbi__write_context* s, int* bitBuf, int* bitCnt, const int* DU, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]);
+
+#ifndef STBIW__JPG_LANES
+static int stbiw__jpg_processDU(stbi__write_context* s, int* bitBuf, int* bitCnt, float* CDU, int du_stride, const float* fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+    int dataOff, i, j, n, x, y;
     int DU[64];
 
     // DCT rows
@@ -1370,6 +1428,16 @@ static int stbiw__jpg_processDU(stbi__write_context* s, int* bitBuf, int* bitCnt
         }
     }
 
+    return stbiw__jpg_encodeDU(s, bitBuf, bitCnt, DU, DC, HTDC, HTAC);
+}
+#endif
+
+// Huffman codes one quantized, zigzagged block; returns its DC for the next block's prediction
+static int stbiw__jpg_encodeDU(stbi__write_context* s, int* bitBuf, int* bitCnt, const int* DU, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+    const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
+    const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
+    int i, diff, end0pos;
+
     // Encode DC
     diff = DU[0] - DC;
     if (diff == 0) {
@@ -1414,7 +1482,320 @@ static int stbiw__jpg_processDU(stbi__write_context* s, int* bitBuf, int* bitCnt
     return DU[0];
 }
 
-static int stbi_write_jpg_core(stbi__write_context* s, int width, int height, int comp, const void* data, int quality) {
+// what encoding a range of MCU rows needs
+typedef struct {
+    const unsigned char* dataR, * dataG, * dataB;
+    int width, height, comp, subsample;
+    float fdtbl_Y[64], fdtbl_UV[64];
+    const unsigned short(*YDC_HT)[2], (*YAC_HT)[2], (*UVDC_HT)[2], (*UVAC_HT)[2];
+} stbiw__jpg_image;
+
+#ifdef STBIW__JPG_LANES
+// stbiw__jpg_DCT on STBIW__JPG_LANES blocks, d[0], d[stride], ... d[7 * stride]
+static void stbiw__jpg_DCT_lanes(stbiw__vf* d, int stride) {
+    stbiw__vf z1, z2, z3, z4, z5, z11, z13;
+    stbiw__vf d0 = d[0], d1 = d[stride], d2 = d[stride * 2], d3 = d[stride * 3], d4 = d[stride * 4], d5 = d[stride * 5], d6 = d[stride * 6], d7 = d[stride * 7];
+
+    stbiw__vf tmp0 = stbiw__vadd(d0, d7);
+    stbiw__vf tmp7 = stbiw__vsub(d0, d7);
+    stbiw__vf tmp1 = stbiw__vadd(d1, d6);
+    stbiw__vf tmp6 = stbiw__vsub(d1, d6);
+    stbiw__vf tmp2 = stbiw__vadd(d2, d5);
+    stbiw__vf tmp5 = stbiw__vsub(d2, d5);
+    stbiw__vf tmp3 = stbiw__vadd(d3, d4);
+    stbiw__vf tmp4 = stbiw__vsub(d3, d4);
+
+    // Even part
+    stbiw__vf tmp10 = stbiw__vadd(tmp0, tmp3);   // phase 2
+    stbiw__vf tmp13 = stbiw__vsub(tmp0, tmp3);
+    stbiw__vf tmp11 = stbiw__vadd(tmp1, tmp2);
+    stbiw__vf tmp12 = stbiw__vsub(tmp1, tmp2);
+
+    d[0] = stbiw__vadd(tmp10, tmp11);       // phase 3
+    d[stride * 4] = stbiw__vsub(tmp10, tmp11);
+
+    z1 = stbiw__vmul(stbiw__vadd(tmp12, tmp13), stbiw__vset1(0.707106781f)); // c4
+    d[stride * 2] = stbiw__vadd(tmp13, z1);       // phase 5
+    d[stride * 6] = stbiw__vsub(tmp13, z1);
+
+    // Odd part
+    tmp10 = stbiw__vadd(tmp4, tmp5);       // phase 2
+    tmp11 = stbiw__vadd(tmp5, tmp6);
+    tmp12 = stbiw__vadd(tmp6, tmp7);
+
+    // The rotator is modified from fig 4-8 to avoid extra negations.
+    z5 = stbiw__vmul(stbiw__vsub(tmp10, tmp12), stbiw__vset1(0.382683433f)); // c6
+    z2 = stbiw__vadd(stbiw__vmul(tmp10, stbiw__vset1(0.541196100f)), z5); // c2-c6
+    z4 = stbiw__vadd(stbiw__vmul(tmp12, stbiw__vset1(1.306562965f)), z5); // c2+c6
+    z3 = stbiw__vmul(tmp11, stbiw__vset1(0.707106781f)); // c4
+
+    z11 = stbiw__vadd(tmp7, z3);      // phase 5
+    z13 = stbiw__vsub(tmp7, z3);
+
+    d[stride * 5] = stbiw__vadd(z13, z2);         // phase 6
+    d[stride * 3] = stbiw__vsub(z13, z2);
+    d[stride * 1] = stbiw__vadd(z11, z4);
+    d[stride * 7] = stbiw__vsub(z11, z4);
+}
+
+// DCT, quantization and zigzag of one 8x8 block per lane into DU[lane * 64 ...]
+static void stbiw__jpg_transformDU_lanes(stbiw__vf* CDU, const float* fdtbl, int* DU) {
+    int i, j, lane;
+    int quantized[STBIW__JPG_LANES];
+    const stbiw__vf sign = stbiw__vset1(-0.0f), half = stbiw__vset1(0.5f);
+    for (i = 0; i < 64; i += 8) {
+        stbiw__jpg_DCT_lanes(&CDU[i], 1);
+    }
+    for (i = 0; i < 8; ++i) {
+        stbiw__jpg_DCT_lanes(&CDU[i], 8);
+    }
+    for (j = 0; j < 64; ++j) {
+        stbiw__vf v = stbiw__vmul(CDU[j], stbiw__vset1(fdtbl[j]));
+        // v < 0 ? v - 0.5f : v + 0.5f, truncated
+        v = stbiw__vadd(v, stbiw__vor(stbiw__vand(v, sign), half));
+        stbiw__vtrunc_store(quantized, v);
+        for (lane = 0; lane < STBIW__JPG_LANES; ++lane) {
+            DU[lane * 64 + stbiw__jpg_ZigZag[j]] = quantized[lane];
+        }
+    }
+}
+
+// the same MCU loop as the scalar writer, STBIW__JPG_LANES horizontally adjacent MCUs at a time
+static void stbiw__jpg_encodeMCUs_lanes(stbi__write_context* s, int* bitBuf, int* bitCnt, int* DCY, int* DCU, int* DCV, const stbiw__jpg_image* im, int y0, int y1) {
+    const unsigned char* dataR = im->dataR, * dataG = im->dataG, * dataB = im->dataB;
+    int width = im->width, height = im->height, comp = im->comp, subsample = im->subsample;
+    int mcu = subsample ? 16 : 8, yBlocks = subsample ? 4 : 1;
+    int x, y, row, col, lane, block, count;
+    stbiw__vf Y[4][64], U[256], V[256], subU[64], subV[64];
+    float r[STBIW__JPG_LANES], g[STBIW__JPG_LANES], b[STBIW__JPG_LANES];
+    int DU[6][STBIW__JPG_LANES * 64];
+
+    for (y = y0; y < y1; y += mcu) {
+        for (x = 0; x < width; x += mcu * STBIW__JPG_LANES) {
+            // MCUs past the right edge are transformed from repeated pixels but not written
+            count = (width - x + mcu - 1) / mcu;
+            count = count < STBIW__JPG_LANES ? count : STBIW__JPG_LANES;
+            for (row = 0; row < mcu; ++row) {
+                // row >= height => use last input row
+                int clamped_row = (y + row < height) ? y + row : height - 1;
+                int base_p = (stbi__flip_vertically_on_write ? (height - 1 - clamped_row) : clamped_row) * width * comp;
+                for (col = 0; col < mcu; ++col) {
+                    stbiw__vf vr, vg, vb, vy;
+                    int pos = row * mcu + col;
+                    for (lane = 0; lane < STBIW__JPG_LANES; ++lane) {
+                        // if col >= width => use pixel from last input column
+                        int c = x + lane * mcu + col;
+                        int p = base_p + ((c < width) ? c : (width - 1)) * comp;
+                        r[lane] = dataR[p];
+                        g[lane] = dataG[p];
+                        b[lane] = dataB[p];
+                    }
+                    vr = stbiw__vload(r);
+                    vg = stbiw__vload(g);
+                    vb = stbiw__vload(b);
+                    vy = stbiw__vsub(stbiw__vadd(stbiw__vadd(stbiw__vmul(stbiw__vset1(+0.29900f), vr), stbiw__vmul(stbiw__vset1(0.58700f), vg)), stbiw__vmul(stbiw__vset1(0.11400f), vb)), stbiw__vset1(128));
+                    Y[(row >> 3) * 2 + (col >> 3)][(row & 7) * 8 + (col & 7)] = vy;
+                    U[pos] = stbiw__vadd(stbiw__vsub(stbiw__vmul(stbiw__vset1(-0.16874f), vr), stbiw__vmul(stbiw__vset1(0.33126f), vg)), stbiw__vmul(stbiw__vset1(0.50000f), vb));
+                    V[pos] = stbiw__vsub(stbiw__vsub(stbiw__vmul(stbiw__vset1(+0.50000f), vr), stbiw__vmul(stbiw__vset1(0.41869f), vg)), stbiw__vmul(stbiw__vset1(0.08131f), vb));
+                }
+            }
+            for (block = 0; block < yBlocks; ++block) {
+                stbiw__jpg_transformDU_lanes(Y[block], im->fdtbl_Y, DU[block]);
+            }
+            if (subsample) {
+                // subsample U,V
+                int yy, xx, pos;
+                for (yy = 0, pos = 0; yy < 8; ++yy) {
+                    for (xx = 0; xx < 8; ++xx, ++pos) {
+                        int j = yy * 32 + xx * 2;
+                        subU[pos] = stbiw__vmul(stbiw__vadd(stbiw__vadd(stbiw__vadd(U[j + 0], U[j + 1]), U[j + 16]), U[j + 17]), stbiw__vset1(0.25f));
+                        subV[pos] = stbiw__vmul(stbiw__vadd(stbiw__vadd(stbiw__vadd(V[j + 0], V[j + 1]), V[j + 16]), V[j + 17]), stbiw__vset1(0.25f));
+                    }
+                }
+                stbiw__jpg_transformDU_lanes(subU, im->fdtbl_UV, DU[4]);
+                stbiw__jpg_transformDU_lanes(subV, im->fdtbl_UV, DU[5]);
+            }
+            else {
+                stbiw__jpg_transformDU_lanes(U, im->fdtbl_UV, DU[4]);
+                stbiw__jpg_transformDU_lanes(V, im->fdtbl_UV, DU[5]);
+            }
+            // entropy coding stays sequential, MCU by MCU
+            for (lane = 0; lane < count; ++lane) {
+                for (block = 0; block < yBlocks; ++block) {
+                    *DCY = stbiw__jpg_encodeDU(s, bitBuf, bitCnt, &DU[block][lane * 64], *DCY, im->YDC_HT, im->YAC_HT);
+                }
+                *DCU = stbiw__jpg_encodeDU(s, bitBuf, bitCnt, &DU[4][lane * 64], *DCU, im->UVDC_HT, im->UVAC_HT);
+                *DCV = stbiw__jpg_encodeDU(s, bitBuf, bitCnt, &DU[5][lane * 64], *DCV, im->UVDC_HT, im->UVAC_HT);
+            }
+        }
+    }
+}
+#endif // STBIW__JPG_LANES
+
+// Encodes pixel rows [y0, y1), whole MCU rows, from fresh DC predictions, and pads the last byte
+// with 1 bits: the whole scan, or one restart interval of it
+static void stbiw__jpg_encodeRows(stbi__write_context* s, const stbiw__jpg_image* im, int y0, int y1) {
+    static const unsigned short fillBits[] = { 0x7F, 7 };
+    int DCY = 0, DCU = 0, DCV = 0;
+    int bitBuf = 0, bitCnt = 0;
+#ifdef STBIW__JPG_LANES
+    stbiw__jpg_encodeMCUs_lanes(s, &bitBuf, &bitCnt, &DCY, &DCU, &DCV, im, y0, y1);
+#else
+    {
+        const unsigned char* dataR = im->dataR, * dataG = im->dataG, * dataB = im->dataB;
+        int width = im->width, height = im->height, comp = im->comp;
+        const float* fdtbl_Y = im->fdtbl_Y, * fdtbl_UV = im->fdtbl_UV;
+        const unsigned short(*YDC_HT)[2] = im->YDC_HT, (*YAC_HT)[2] = im->YAC_HT, (*UVDC_HT)[2] = im->UVDC_HT, (*UVAC_HT)[2] = im->UVAC_HT;
+        int x, y, pos, row, col;
+        if (im->subsample) {
+            for (y = y0; y < y1; y += 16) {
+                for (x = 0; x < width; x += 16) {
+                    float Y[256], U[256], V[256];
+                    for (row = y, pos = 0; row < y + 16; ++row) {
+                        // row >= height => use last input row
+                        int clamped_row = (row < height) ? row : height - 1;
+                        int base_p = (stbi__flip_vertically_on_write ? (height - 1 - clamped_row) : clamped_row) * width * comp;
+                        for (col = x; col < x + 16; ++col, ++pos) {
+                            // if col >= width => use pixel from last input column
+                            int p = base_p + ((col < width) ? col : (width - 1)) * comp;
+                            float r = dataR[p], g = dataG[p], b = dataB[p];
+                            Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+                            U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+                            V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+                        }
+                    }
+                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 0, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 8, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 128, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 136, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+
+                    // subsample U,V
+                    {
+                        float subU[64], subV[64];
+                        int yy, xx;
+                        for (yy = 0, pos = 0; yy < 8; ++yy) {
+                            for (xx = 0; xx < 8; ++xx, ++pos) {
+                                int j = yy * 32 + xx * 2;
+                                subU[pos] = (U[j + 0] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
+                                subV[pos] = (V[j + 0] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
+                            }
+                        }
+                        DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
+                        DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+                    }
+                }
+            }
+        }
+        else {
+            for (y = y0; y < y1; y += 8) {
+                for (x = 0; x < width; x += 8) {
+                    float Y[64], U[64], V[64];
+                    for (row = y, pos = 0; row < y + 8; ++row) {
+                        // row >= height => use last input row
+                        int clamped_row = (row < height) ? row : height - 1;
+                        int base_p = (stbi__flip_vertically_on_write ? (height - 1 - clamped_row) : clamped_row) * width * comp;
+                        for (col = x; col < x + 8; ++col, ++pos) {
+                            // if col >= width => use pixel from last input column
+                            int p = base_p + ((col < width) ? col : (width - 1)) * comp;
+                            float r = dataR[p], g = dataG[p], b = dataB[p];
+                            Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+                            U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+                            V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+                        }
+                    }
+
+                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, fdtbl_Y, DCY, YDC_HT, YAC_HT);
+                    DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
+                    DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+                }
+            }
+        }
+    }
+#endif
+
+    // Do the bit alignment of the EOI (or RSTn) marker
+    stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
+}
+
+// one restart interval, encoded into memory
+typedef struct {
+    unsigned char* data;
+    int size, capacity, failed;
+} stbiw__jpg_stripe;
+
+static void stbiw__jpg_stripe_write(void* context, void* data, int size) {
+    stbiw__jpg_stripe* stripe = (stbiw__jpg_stripe*)context;
+    if (stripe->size + size > stripe->capacity) {
+        int capacity = stripe->capacity ? stripe->capacity * 2 : 65536;
+        unsigned char* grown;
+        while (capacity < stripe->size + size) {
+            capacity *= 2;
+        }
+        grown = (unsigned char*)STBIW_REALLOC_SIZED(stripe->data, stripe->capacity, capacity);
+        if (!grown) {
+            stripe->failed = 1;
+            return;
+        }
+        stripe->data = grown;
+        stripe->capacity = capacity;
+    }
+    memcpy(stripe->data + stripe->size, data, size);
+    stripe->size += size;
+}
+
+typedef struct {
+    const stbiw__jpg_image* im;
+    stbiw__jpg_stripe* stripes;
+    int rows;
+} stbiw__jpg_stripe_job;
+
+static void stbiw__jpg_encodeStripe(void* job_context, int index) {
+    stbiw__jpg_stripe_job* job = (stbiw__jpg_stripe_job*)job_context;
+    stbi__write_context s = { 0 };
+    int y0 = index * job->rows, y1 = y0 + job->rows;
+    stbi__start_write_callbacks(&s, stbiw__jpg_stripe_write, &job->stripes[index]);
+    stbiw__jpg_encodeRows(&s, job->im, y0, y1 < job->im->height ? y1 : job->im->height);
+}
+
+// encodes the scan in stripes of 'rows' pixel rows (the restart interval) and writes them in order
+// with RST0..RST7 between them
+static int stbiw__jpg_encodeStripes(stbi__write_context* s, const stbiw__jpg_image* im, int rows, stbi_write_parallel_func* parallel, void* parallel_context) {
+    int count = (im->height + rows - 1) / rows, i, ok = 1;
+    stbiw__jpg_stripe_job job;
+    job.im = im;
+    job.rows = rows;
+    job.stripes = (stbiw__jpg_stripe*)STBIW_MALLOC(sizeof(stbiw__jpg_stripe) * count);
+    if (!job.stripes) {
+        return 0;
+    }
+    memset(job.stripes, 0, sizeof(stbiw__jpg_stripe) * count);
+    if (parallel) {
+        parallel(parallel_context, count, stbiw__jpg_encodeStripe, &job);
+    }
+    else {
+        for (i = 0; i < count; ++i) {
+            stbiw__jpg_encodeStripe(&job, i);
+        }
+    }
+    for (i = 0; i < count; ++i) {
+        ok = ok && !job.stripes[i].failed;
+    }
+    for (i = 0; ok && i < count; ++i) {
+        s->func(s->context, job.stripes[i].data, job.stripes[i].size);
+        if (i + 1 < count) {
+            stbiw__putc(s, 0xFF);
+            stbiw__putc(s, (unsigned char)(0xD0 + (i & 7)));
+        }
+    }
+    for (i = 0; i < count; ++i) {
+        STBIW_FREE(job.stripes[i].data);
+    }
+    STBIW_FREE(job.stripes);
+    return ok;
+}
+
+static int stbi_write_jpg_core(stbi__write_context* s, int width, int height, int comp, const void* data, int quality,
+    int stripes, stbi_write_parallel_func* parallel, void* parallel_context) {
     // Constants that don't pollute global namespace
     static const unsigned char std_dc_luminance_nrcodes[] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
     static const unsigned char std_dc_luminance_values[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
@@ -1486,8 +1867,9 @@ static int stbi_write_jpg_core(stbi__write_context* s, int width, int height, in
     static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
                                   1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
 
-    int row, col, i, k, subsample;
-    float fdtbl_Y[64], fdtbl_UV[64];
+    int row, col, i, k, subsample, restartRows = 0, restartInterval = 0;
+    stbiw__jpg_image im;
+    float* fdtbl_Y = im.fdtbl_Y, * fdtbl_UV = im.fdtbl_UV;
     unsigned char YTable[64], UVTable[64];
 
     if (!data || !width || !height || comp > 4 || comp < 1) {
@@ -1513,6 +1895,17 @@ static int stbi_write_jpg_core(stbi__write_context* s, int width, int height, in
         }
     }
 
+    // restart interval: whole MCU rows, at most 65535 MCUs
+    if (stripes > 1) {
+        int mcu = subsample ? 16 : 8, mcusPerRow = (width + mcu - 1) / mcu, mcuRows = (height + mcu - 1) / mcu;
+        int intervalRows = (mcuRows + stripes - 1) / stripes;
+        intervalRows = intervalRows < 65535 / mcusPerRow ? intervalRows : 65535 / mcusPerRow;
+        if (intervalRows < mcuRows) {
+            restartRows = intervalRows * mcu;
+            restartInterval = intervalRows * mcusPerRow;
+        }
+    }
+
     // Write Headers
     {
         static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
@@ -1535,86 +1928,34 @@ static int stbi_write_jpg_core(stbi__write_context* s, int width, int height, in
         stbiw__putc(s, 0x11); // HTUACinfo
         s->func(s->context, (void*)(std_ac_chrominance_nrcodes + 1), sizeof(std_ac_chrominance_nrcodes) - 1);
         s->func(s->context, (void*)std_ac_chrominance_values, sizeof(std_ac_chrominance_values));
+        if (restartInterval) {
+            const unsigned char dri[] = { 0xFF,0xDD,0,4,(unsigned char)(restartInterval >> 8),STBIW_UCHAR(restartInterval) };
+            s->func(s->context, (void*)dri, sizeof(dri));
+        }
         s->func(s->context, (void*)head2, sizeof(head2));
     }
 
     // Encode 8x8 macroblocks
     {
-        static const unsigned short fillBits[] = { 0x7F, 7 };
-        int DCY = 0, DCU = 0, DCV = 0;
-        int bitBuf = 0, bitCnt = 0;
         // comp == 2 is grey+alpha (alpha is ignored)
         int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
-        const unsigned char* dataR = (const unsigned char*)data;
-        const unsigned char* dataG = dataR + ofsG;
-        const unsigned char* dataB = dataR + ofsB;
-        int x, y, pos;
-        if (subsample) {
-            for (y = 0; y < height; y += 16) {
-                for (x = 0; x < width; x += 16) {
-                    float Y[256], U[256], V[256];
-                    for (row = y, pos = 0; row < y + 16; ++row) {
-                        // row >= height => use last input row
-                        int clamped_row = (row < height) ? row : height - 1;
-                        int base_p = (stbi__flip_vertically_on_write ? (height - 1 - clamped_row) : clamped_row) * width * comp;
-                        for (col = x; col < x + 16; ++col, ++pos) {
-                            // if col >= width => use pixel from last input column
-                            int p = base_p + ((col < width) ? col : (width - 1)) * comp;
-                            float r = dataR[p], g = dataG[p], b = dataB[p];
-                            Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
-                            U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
-                            V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
-                        }
-                    }
-                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 0, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 8, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 128, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y + 136, 16, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-
-                    // subsample U,V
-                    {
-                        float subU[64], subV[64];
-                        int yy, xx;
-                        for (yy = 0, pos = 0; yy < 8; ++yy) {
-                            for (xx = 0; xx < 8; ++xx, ++pos) {
-                                int j = yy * 32 + xx * 2;
-                                subU[pos] = (U[j + 0] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
-                                subV[pos] = (V[j + 0] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
-                            }
-                        }
-                        DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subU, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                        DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, subV, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
-                    }
-                }
-            }
+        im.dataR = (const unsigned char*)data;
+        im.dataG = im.dataR + ofsG;
+        im.dataB = im.dataR + ofsB;
+        im.width = width;
+        im.height = height;
+        im.comp = comp;
+        im.subsample = subsample;
+        im.YDC_HT = YDC_HT;
+        im.YAC_HT = YAC_HT;
+        im.UVDC_HT = UVDC_HT;
+        im.UVAC_HT = UVAC_HT;
+        if (restartRows == 0) {
+            stbiw__jpg_encodeRows(s, &im, 0, height);
         }
-        else {
-            for (y = 0; y < height; y += 8) {
-                for (x = 0; x < width; x += 8) {
-                    float Y[64], U[64], V[64];
-                    for (row = y, pos = 0; row < y + 8; ++row) {
-                        // row >= height => use last input row
-                        int clamped_row = (row < height) ? row : height - 1;
-                        int base_p = (stbi__flip_vertically_on_write ? (height - 1 - clamped_row) : clamped_row) * width * comp;
-                        for (col = x; col < x + 8; ++col, ++pos) {
-                            // if col >= width => use pixel from last input column
-                            int p = base_p + ((col < width) ? col : (width - 1)) * comp;
-                            float r = dataR[p], g = dataG[p], b = dataB[p];
-                            Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
-                            U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
-                            V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
-                        }
-                    }
-
-                    DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, Y, 8, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-                    DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, U, 8, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-                    DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, V, 8, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
-                }
-            }
+        else if (!stbiw__jpg_encodeStripes(s, &im, restartRows, parallel, parallel_context)) {
+            return 0;
         }
-
-        // Do the bit alignment of the EOI marker
-        stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
     }
 
     // EOI
@@ -1628,7 +1969,15 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func* func, void* context, int x,
 {
     stbi__write_context s = { 0 };
     stbi__start_write_callbacks(&s, func, context);
-    return stbi_write_jpg_core(&s, x, y, comp, (void*)data, quality);
+    return stbi_write_jpg_core(&s, x, y, comp, (void*)data, quality, 1, NULL, NULL);
+}
+
+STBIWDEF int stbi_write_jpg_striped_to_func(stbi_write_func* func, void* context, int x, int y, int comp, const void* data, int quality,
+    int stripes, stbi_write_parallel_func* parallel, void* parallel_context)
+{
+    stbi__write_context s = { 0 };
+    stbi__start_write_callbacks(&s, func, context);
+    return stbi_write_jpg_core(&s, x, y, comp, (void*)data, quality, stripes, parallel, parallel_context);
 }
 
 
@@ -1637,7 +1986,7 @@ STBIWDEF int stbi_write_jpg(char const* filename, int x, int y, int comp, const
 {
     stbi__write_context s = { 0 };
     if (stbi__start_write_file(&s, filename)) {
-        int r = stbi_write_jpg_core(&s, x, y, comp, data, quality);
+        int r = stbi_write_jpg_core(&s, x, y, comp, data, quality, 1, NULL, NULL);
         stbi__end_write_file(&s);
         return r;
     }
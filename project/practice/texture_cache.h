@@ -0,0 +1,220 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "texture_cook.h"
+#include "texture_stream.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process wide texture cache. Every texture load (loadTexture, Model materials) goes through it,
+// keyed by the canonical file path and the load parameters, so a file used by several models or
+// scenes is loaded and uploaded once. Files are loaded through their cooked copy (texture_cook.h),
+// either right away or, with TextureStreamer enabled, in the background behind a placeholder.
+// Entries are reference counted and deleted with the last Release.
+
+// creates the GL texture from a cooked image (see texture_cook.h); context thread only
+inline unsigned int UploadTexture(const CookedTexture& texture, const char* path, bool gamma = false, TextureWrap wrap = TEXTURE_WRAP_REPEAT)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (texture.Valid())
+    {
+        GLint wrapMode = textureWrapMode(wrap, texture.components);
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadCookedTexture(texture, gamma);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    }
+
+    return textureID;
+}
+
+// '/' separators, no '.'/'..' parts
+inline std::string normalizeTexturePath(const std::string& path)
+{
+    std::vector<std::string> parts;
+    bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find_first_of("/\\", start);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string part = path.substr(start, end - start);
+        if (part == "..")
+        {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!absolute)
+                parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".")
+            parts.push_back(part);
+        start = end + 1;
+    }
+    std::string result = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i)
+        result += (i ? "/" : "") + parts[i];
+    return result;
+}
+
+// absolute, normalized path (lower case on Windows), so different spellings of the same file
+// share a cache entry. Files that can't be resolved keep their normalized relative path.
+inline std::string canonicalTexturePath(const std::string& path)
+{
+    std::string resolved = normalizeTexturePath(path);
+#ifdef _WIN32
+    char buffer[4096];
+    if (_fullpath(buffer, resolved.c_str(), sizeof(buffer)))
+        resolved = normalizeTexturePath(buffer);
+    for (char& c : resolved)
+        if (c >= 'A' && c <= 'Z')
+            c = (char)(c - 'A' + 'a');
+#else
+    if (char* real = realpath(resolved.c_str(), NULL))
+    {
+        resolved = real;
+        std::free(real);
+    }
+#endif
+    return resolved;
+}
+
+class TextureCache
+{
+public:
+    static TextureCache& Get()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the texture for path, loading it on first use; every Acquire needs a Release.
+    // colorData: the image holds colours (mips are filtered in linear light), not vectors or masks
+    unsigned int Acquire(const std::string& path, bool gamma = false, TextureWrap wrap = TEXTURE_WRAP_REPEAT, bool colorData = true)
+    {
+        std::vector<unsigned int> ids;
+        AcquireAll(std::vector<std::string>(1, path), gamma, wrap, ids, colorData);
+        return ids[0];
+    }
+
+    // Acquire for a batch: the files not cached yet are loaded (cooked on first use) in parallel
+    // on the shared thread pool, then uploaded here. ids[i] belongs to paths[i]. When streaming,
+    // the ids are placeholders right away and the images arrive over the next frames.
+    void AcquireAll(const std::vector<std::string>& paths, bool gamma, TextureWrap wrap, std::vector<unsigned int>& ids, bool colorData = true)
+    {
+        TRACE_ZONE("acquire textures");
+        ids.assign(paths.size(), 0);
+        std::vector<Key> keys(paths.size());
+        std::vector<size_t> missing;        // first request index of every key that has to be loaded
+        std::unordered_map<Key, size_t, KeyHash> pending;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            keys[i] = Key{ canonicalTexturePath(paths[i]), gamma, wrap, colorData };
+            if (entries.count(keys[i]) == 0 && pending.count(keys[i]) == 0)
+            {
+                pending[keys[i]] = i;
+                missing.push_back(i);
+            }
+        }
+
+        if (TextureStreamer::Get().Enabled())
+        {
+            for (size_t m = 0; m < missing.size(); ++m)
+            {
+                Entry entry;
+                entry.id = createPlaceholderTexture();
+                TextureStreamer::Get().Stream(entry.id, paths[missing[m]], gamma, wrap, colorData);
+                entries[keys[missing[m]]] = entry;
+                keysById[entry.id] = keys[missing[m]];
+            }
+            missing.clear();
+        }
+
+        std::vector<std::unique_ptr<CookedTexture>> images(missing.size());
+        ThreadPool::Shared().ParallelFor(missing.size(), [&](size_t m) {
+            images[m].reset(new CookedTexture());
+            loadCookedTexture(paths[missing[m]], colorData, *images[m]);
+        });
+        for (size_t m = 0; m < missing.size(); ++m)
+        {
+            const std::string& path = paths[missing[m]];
+            Entry entry;
+            entry.id = UploadTexture(*images[m], path.c_str(), gamma, wrap);
+            images[m].reset();      // unmaps the file / frees the levels
+            entries[keys[missing[m]]] = entry;
+            keysById[entry.id] = keys[missing[m]];
+        }
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            Entry& entry = entries[keys[i]];
+            ++entry.references;
+            ids[i] = entry.id;
+        }
+    }
+
+    // drops one reference; the texture is deleted when none are left
+    void Release(unsigned int id)
+    {
+        auto found = keysById.find(id);
+        if (found == keysById.end())
+            return;
+        auto entry = entries.find(found->second);
+        if (--entry->second.references == 0)
+        {
+            TextureStreamer::Get().Cancel(id);
+            glDeleteTextures(1, &id);
+            entries.erase(entry);
+            keysById.erase(found);
+        }
+    }
+
+    size_t Size() const { return entries.size(); }
+
+private:
+    struct Key {
+        std::string path;
+        bool gamma;
+        TextureWrap wrap;
+        bool colorData;
+        bool operator==(const Key& other) const
+        {
+            return gamma == other.gamma && wrap == other.wrap && colorData == other.colorData && path == other.path;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const
+        {
+            return std::hash<std::string>()(key.path) ^ ((size_t)key.gamma * 0x9e3779b9u) ^ ((size_t)key.wrap << 16) ^ ((size_t)key.colorData << 20);
+        }
+    };
+    struct Entry {
+        unsigned int id = 0;
+        unsigned int references = 0;
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::unordered_map<unsigned int, Key> keysById;
+};
+
+#endif
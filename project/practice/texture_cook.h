@@ -0,0 +1,368 @@
+#ifndef TEXTURE_COOK_H
+#define TEXTURE_COOK_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "gl_ext.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COOK_SSE2 1
+#include <emmintrin.h>
+#else
+#define TEXTURE_COOK_SSE2 0
+#endif
+
+// Cooked textures: the decoded image plus its complete mip chain in one raw file next to the
+// source (<image>.ctex, or <image>.srgb.ctex for colour data), tied to the source by a content
+// hash. The mips are box filtered on the CPU (SSE2 where available), colour channels in linear
+// light so distant surfaces don't darken. Loading maps the file and uploads every level with
+// glTexStorage2D + glTexSubImage2D; neither stb_image nor glGenerateMipmap run after the first time.
+
+#define TEXTURE_COOK_VERSION 1
+#define TEXTURE_COOK_MAX_LEVELS 16
+#define TEXTURE_COOK_ALIGNMENT 16
+// destination rows per ParallelFor item while filtering a level
+#define TEXTURE_COOK_ROWS_PER_JOB 32
+
+struct CookedTextureHeader {
+    char     magic[4];          // "PTEX"
+    uint32_t version;
+    uint64_t sourceHash;        // hashFile() of the source image, seeded with the colour space
+    uint32_t width;
+    uint32_t height;
+    uint32_t components;        // 1..4, tightly packed rows
+    uint32_t levels;
+    uint32_t colorData;         // colour channels were filtered as sRGB
+    uint32_t reserved;
+    uint64_t levelOffset[TEXTURE_COOK_MAX_LEVELS];
+};
+
+// a cooked texture in memory: either a mapping of the cooked file or freshly cooked levels
+struct CookedTexture {
+    int width = 0, height = 0, components = 0, levels = 0;
+    const unsigned char* level[TEXTURE_COOK_MAX_LEVELS] = {};
+    MappedFile file;
+    std::vector<unsigned char> storage;
+
+    bool Valid() const { return levels > 0; }
+};
+
+inline int cookedLevelWidth(int width, int level) { return std::max(width >> level, 1); }
+inline int cookedLevelHeight(int height, int level) { return std::max(height >> level, 1); }
+inline size_t cookedLevelBytes(int width, int height, int components, int level)
+{
+    return (size_t)cookedLevelWidth(width, level) * cookedLevelHeight(height, level) * components;
+}
+
+// ----------------------------------------------------------------------------
+// sRGB aware box filter
+// ----------------------------------------------------------------------------
+
+#define TEXTURE_COOK_LINEAR_STEPS 16384     // resolution of the linear -> sRGB table
+
+struct SrgbTables {
+    float toLinear[256];
+    unsigned char fromLinear[TEXTURE_COOK_LINEAR_STEPS + 1];
+
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i <= TEXTURE_COOK_LINEAR_STEPS; ++i)
+        {
+            float l = (float)i / TEXTURE_COOK_LINEAR_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            fromLinear[i] = (unsigned char)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+        }
+    }
+
+    static const SrgbTables& Get()
+    {
+        static SrgbTables tables;
+        return tables;
+    }
+};
+
+// one source row to linear floats; srgbChannels leading channels go through the sRGB curve
+inline void cookRowToLinear(const unsigned char* src, int texels, int components, int srgbChannels, float* dst)
+{
+    const SrgbTables& tables = SrgbTables::Get();
+    for (int x = 0; x < texels; ++x)
+        for (int c = 0; c < components; ++c, ++src, ++dst)
+            *dst = c < srgbChannels ? tables.toLinear[*src] : *src * (1.0f / 255.0f);
+}
+
+// averages 2x2 blocks of two linear rows into one (edge texels repeat on odd sizes)
+inline void cookDownsampleRow(const float* row0, const float* row1, int srcWidth, int dstWidth, int components, float* dst)
+{
+#if TEXTURE_COOK_SSE2
+    if (components == 4)
+    {
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (int x = 0; x < dstWidth; ++x)
+        {
+            int x0 = std::min(2 * x, srcWidth - 1) * 4, x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(dst + x * 4, _mm_mul_ps(sum, quarter));
+        }
+        return;
+    }
+#endif
+    for (int x = 0; x < dstWidth; ++x)
+    {
+        int x0 = std::min(2 * x, srcWidth - 1) * components, x1 = std::min(2 * x + 1, srcWidth - 1) * components;
+        for (int c = 0; c < components; ++c)
+            dst[x * components + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+    }
+}
+
+// linear floats back to bytes
+inline void cookRowFromLinear(const float* src, int texels, int components, int srgbChannels, unsigned char* dst)
+{
+    const SrgbTables& tables = SrgbTables::Get();
+    int count = texels * components;
+    int i = 0;
+#if TEXTURE_COOK_SSE2
+    if (components == 4 && srgbChannels == 3)
+    {
+        // table indices for rgb, rounded bytes for alpha, four channels at a time
+        const __m128 scale = _mm_setr_ps((float)TEXTURE_COOK_LINEAR_STEPS, (float)TEXTURE_COOK_LINEAR_STEPS, (float)TEXTURE_COOK_LINEAR_STEPS, 255.0f);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        alignas(16) int32_t index[4];
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+            _mm_store_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+            dst[i] = tables.fromLinear[index[0]];
+            dst[i + 1] = tables.fromLinear[index[1]];
+            dst[i + 2] = tables.fromLinear[index[2]];
+            dst[i + 3] = (unsigned char)index[3];
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        float v = std::min(std::max(src[i], 0.0f), 1.0f);
+        if (i % components < srgbChannels)
+            dst[i] = tables.fromLinear[(int)(v * TEXTURE_COOK_LINEAR_STEPS + 0.5f)];
+        else
+            dst[i] = (unsigned char)(v * 255.0f + 0.5f);
+    }
+}
+
+// next level from the previous one, rows split across the thread pool
+inline void cookMipLevel(const unsigned char* src, int srcWidth, int srcHeight, int components, int srgbChannels,
+                         unsigned char* dst, int dstWidth, int dstHeight)
+{
+    size_t jobs = ((size_t)dstHeight + TEXTURE_COOK_ROWS_PER_JOB - 1) / TEXTURE_COOK_ROWS_PER_JOB;
+    ThreadPool::Shared().ParallelFor(jobs, [&](size_t job) {
+        std::vector<float> row0((size_t)srcWidth * components), row1((size_t)srcWidth * components), out((size_t)dstWidth * components);
+        int first = (int)job * TEXTURE_COOK_ROWS_PER_JOB, last = std::min(first + TEXTURE_COOK_ROWS_PER_JOB, dstHeight);
+        for (int y = first; y < last; ++y)
+        {
+            int y0 = std::min(2 * y, srcHeight - 1), y1 = std::min(2 * y + 1, srcHeight - 1);
+            cookRowToLinear(src + (size_t)y0 * srcWidth * components, srcWidth, components, srgbChannels, row0.data());
+            cookRowToLinear(src + (size_t)y1 * srcWidth * components, srcWidth, components, srgbChannels, row1.data());
+            cookDownsampleRow(row0.data(), row1.data(), srcWidth, dstWidth, components, out.data());
+            cookRowFromLinear(out.data(), dstWidth, components, srgbChannels, dst + (size_t)y * dstWidth * components);
+        }
+    });
+}
+
+// ----------------------------------------------------------------------------
+// cooking and loading
+// ----------------------------------------------------------------------------
+
+inline std::string cookedTexturePath(const std::string& source, bool colorData)
+{
+    return source + (colorData ? ".srgb.ctex" : ".ctex");
+}
+
+// builds header and file layout for an image of the given size
+inline CookedTextureHeader cookedTextureLayout(uint64_t sourceHash, int width, int height, int components, bool colorData)
+{
+    CookedTextureHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "PTEX", 4);
+    header.version = TEXTURE_COOK_VERSION;
+    header.sourceHash = sourceHash;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.components = (uint32_t)components;
+    header.colorData = colorData ? 1 : 0;
+    int levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0)
+        ++levels;
+    header.levels = (uint32_t)std::min(levels, TEXTURE_COOK_MAX_LEVELS);
+    uint64_t offset = (sizeof(CookedTextureHeader) + TEXTURE_COOK_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_COOK_ALIGNMENT - 1);
+    for (uint32_t level = 0; level < header.levels; ++level)
+    {
+        header.levelOffset[level] = offset;
+        offset += cookedLevelBytes(width, height, components, (int)level);
+        offset = (offset + TEXTURE_COOK_ALIGNMENT - 1) & ~(uint64_t)(TEXTURE_COOK_ALIGNMENT - 1);
+    }
+    return header;
+}
+
+inline bool openCookedTexture(const std::string& path, uint64_t sourceHash, bool colorData, CookedTexture& texture)
+{
+    if (!texture.file.Open(path) || texture.file.Size() < sizeof(CookedTextureHeader))
+        return false;
+    CookedTextureHeader header;
+    std::memcpy(&header, texture.file.Data(), sizeof(header));
+    if (std::memcmp(header.magic, "PTEX", 4) != 0 || header.version != TEXTURE_COOK_VERSION || header.sourceHash != sourceHash
+        || header.colorData != (colorData ? 1u : 0u) || header.components < 1 || header.components > 4
+        || header.width == 0 || header.height == 0)
+        return false;
+    // the layout is fully determined by the size, so compare against a freshly computed one
+    CookedTextureHeader expected = cookedTextureLayout(sourceHash, (int)header.width, (int)header.height, (int)header.components, colorData);
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+    size_t last = expected.levels - 1;
+    if (expected.levelOffset[last] + cookedLevelBytes(header.width, header.height, header.components, (int)last) > texture.file.Size())
+        return false;
+    texture.width = (int)header.width;
+    texture.height = (int)header.height;
+    texture.components = (int)header.components;
+    texture.levels = (int)header.levels;
+    for (int level = 0; level < texture.levels; ++level)
+        texture.level[level] = texture.file.Data() + header.levelOffset[level];
+    return true;
+}
+
+// decodes the source and filters the mip chain into texture.storage, then writes the cooked file
+inline bool cookTexture(const std::string& source, const std::string& path, uint64_t sourceHash, bool colorData, CookedTexture& texture)
+{
+    TRACE_ZONE("cook texture");
+    int width, height, components;
+    unsigned char* data = stbi_load(source.c_str(), &width, &height, &components, 0);
+    if (!data)
+        return false;
+    CookedTextureHeader header = cookedTextureLayout(sourceHash, width, height, components, colorData);
+    size_t last = header.levels - 1;
+    texture.storage.assign(header.levelOffset[last] + cookedLevelBytes(width, height, components, (int)last), 0);
+    std::memcpy(&texture.storage[0], &header, sizeof(header));
+    std::memcpy(&texture.storage[header.levelOffset[0]], data, cookedLevelBytes(width, height, components, 0));
+    stbi_image_free(data);
+
+    // alpha (the last channel of 2 and 4 channel images) is always filtered linearly
+    int srgbChannels = colorData ? (components == 2 || components == 4 ? components - 1 : components) : 0;
+    for (uint32_t level = 1; level < header.levels; ++level)
+        cookMipLevel(&texture.storage[header.levelOffset[level - 1]], cookedLevelWidth(width, level - 1), cookedLevelHeight(height, level - 1),
+                     components, srgbChannels,
+                     &texture.storage[header.levelOffset[level]], cookedLevelWidth(width, level), cookedLevelHeight(height, level));
+
+    texture.width = width;
+    texture.height = height;
+    texture.components = components;
+    texture.levels = (int)header.levels;
+    for (int level = 0; level < texture.levels; ++level)
+        texture.level[level] = &texture.storage[header.levelOffset[level]];
+
+    // written to a temporary name first so a reader never maps a half written file
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write((const char*)texture.storage.data(), (std::streamsize)texture.storage.size());
+    out.close();
+    if (!out)
+    {
+        std::remove(temporary.c_str());
+        std::cout << "ERROR::TEXTURE_COOK::WRITE_FAILED: " << path << std::endl;
+        return true;    // the levels are still usable for this run
+    }
+    std::remove(path.c_str());
+    std::rename(temporary.c_str(), path.c_str());
+    return true;
+}
+
+// worker thread: maps the cooked copy of source, cooking it first if it's missing or stale.
+// colorData selects linear light filtering for the colour channels.
+inline bool loadCookedTexture(const std::string& source, bool colorData, CookedTexture& texture)
+{
+    TRACE_ZONE("load cooked texture");
+    uint64_t sourceHash;
+    if (!hashFile(source, sourceHash, hashBytes("texture cook", 12) ^ (colorData ? 1u : 0u)))
+        return false;
+    std::string path = cookedTexturePath(source, colorData);
+    if (openCookedTexture(path, sourceHash, colorData, texture))
+        return true;
+    texture.file.Close();
+    return cookTexture(source, path, sourceHash, colorData, texture);
+}
+
+enum TextureWrap {
+    TEXTURE_WRAP_REPEAT,
+    TEXTURE_WRAP_CLAMP,
+    TEXTURE_WRAP_AUTO       // clamp images with alpha (no semi-transparent borders), repeat the rest
+};
+
+inline GLint textureWrapMode(TextureWrap wrap, int components)
+{
+    return wrap == TEXTURE_WRAP_CLAMP || (wrap == TEXTURE_WRAP_AUTO && components == 4) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+}
+
+inline GLenum cookedTextureFormat(const CookedTexture& texture)
+{
+    static const GLenum formats[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    return formats[texture.components];
+}
+
+// context thread, texture bound to GL_TEXTURE_2D: storage for every level without any pixels.
+// Immutable (glTexStorage2D) where available, otherwise each level is specified with glTexImage2D.
+inline void allocateCookedTexture(const CookedTexture& texture, bool gamma)
+{
+    static const GLenum sizedFormats[5] = { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    // gamma corrected textures are stored as sRGB so sampling returns linear values
+    GLenum internalFormat = sizedFormats[texture.components];
+    if (gamma && texture.components == 3)
+        internalFormat = GL_SRGB8;
+    else if (gamma && texture.components == 4)
+        internalFormat = GL_SRGB8_ALPHA8;
+
+    if (glext().TexStorage2D)
+        glext().TexStorage2D(GL_TEXTURE_2D, texture.levels, internalFormat, texture.width, texture.height);
+    else
+        for (int level = 0; level < texture.levels; ++level)
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, cookedLevelWidth(texture.width, level), cookedLevelHeight(texture.height, level),
+                         0, cookedTextureFormat(texture), GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+}
+
+// context thread, texture bound: rows [y, y + rows) of a level from pixels (client memory, or an
+// offset into the bound GL_PIXEL_UNPACK_BUFFER)
+inline void uploadCookedRows(const CookedTexture& texture, int level, int y, int rows, const void* pixels)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, cookedLevelWidth(texture.width, level), rows, cookedTextureFormat(texture), GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// context thread, texture bound: allocates and uploads every level straight from the mapping
+inline void uploadCookedTexture(const CookedTexture& texture, bool gamma)
+{
+    allocateCookedTexture(texture, gamma);
+    for (int level = 0; level < texture.levels; ++level)
+        uploadCookedRows(texture, level, 0, cookedLevelHeight(texture.height, level), texture.level[level]);
+}
+
+#endif
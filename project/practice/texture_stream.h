@@ -0,0 +1,375 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <glad/glad.h>
+
+#include "texture_cook.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous texture uploads. A streamed texture is usable right away: it starts as a 1x1 grey
+// placeholder, gets its full storage and smallest mips once a worker has loaded the cooked file,
+// and then sharpens level by level (smallest first, GL_TEXTURE_BASE_LEVEL follows the resident
+// levels). The large levels travel through a ring of pixel unpack buffers: the render thread
+// maps (orphans) a free buffer, a worker copies the rows into it, the render thread issues the
+// glTexSubImage2D from it and fences it. At most frameBudget bytes are handed out per Update().
+
+#define TEXTURE_STREAM_STAGING_COUNT 4
+#define TEXTURE_STREAM_STAGING_BYTES (4 * 1024 * 1024)
+#define TEXTURE_STREAM_FRAME_BUDGET (8 * 1024 * 1024)
+// mip levels this small are uploaded directly from client memory as soon as storage exists
+#define TEXTURE_STREAM_DIRECT_BYTES (16 * 1024)
+
+// context thread: a 1x1 mid grey texture standing in until the real levels arrive
+inline unsigned int createPlaceholderTexture()
+{
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+class TextureStreamer
+{
+public:
+    static TextureStreamer& Get()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    size_t frameBudget = TEXTURE_STREAM_FRAME_BUDGET;   // bytes handed to the staging buffers per Update()
+
+    void SetEnabled(bool enable) { enabled = enable; }
+    bool Enabled() const { return enabled; }
+
+    // queues the file behind an existing (placeholder) texture; the texture keeps its name
+    void Stream(unsigned int texture, const std::string& path, bool gamma, TextureWrap wrap, bool colorData)
+    {
+        std::shared_ptr<Record> record = std::make_shared<Record>();
+        record->id = texture;
+        record->path = path;
+        record->gamma = gamma;
+        record->wrap = wrap;
+        record->image.reset(new CookedTexture());
+        active.push_back(record);
+        ThreadPool::Shared().Submit([record, colorData]() {
+            if (!record->canceled)
+                record->failed = !loadCookedTexture(record->path, colorData, *record->image);
+            record->loaded = true;
+        });
+    }
+
+    // stops streaming into a texture that is about to be deleted
+    void Cancel(unsigned int texture)
+    {
+        for (size_t i = 0; i < active.size(); ++i)
+            if (active[i]->id == texture)
+            {
+                active[i]->canceled = true;
+                active.erase(active.begin() + i);
+                return;
+            }
+    }
+
+    // textures that aren't complete yet
+    size_t Pending() const { return active.size(); }
+
+    // context thread, once per frame
+    void Update()
+    {
+        TRACE_ZONE("texture streaming");
+        if (active.empty() && idle())
+            return;
+        if (staging[0].buffer == 0)
+            init();
+        retire(0);
+        issue();
+        allocateLoaded();
+        fill(frameBudget);
+        active.erase(std::remove_if(active.begin(), active.end(), [](const std::shared_ptr<Record>& record) {
+            return record->canceled || record->residentLevel == 0;
+        }), active.end());
+    }
+
+    // context thread: blocks until every queued texture is complete (offline rendering, tests)
+    void Finish()
+    {
+        TRACE_ZONE("texture streaming finish");
+        while (!active.empty() || !idle())
+        {
+            if (staging[0].buffer == 0)
+                init();
+            retire(GL_TIMEOUT_IGNORED);
+            issue();
+            allocateLoaded();
+            fill(SIZE_MAX);
+            active.erase(std::remove_if(active.begin(), active.end(), [](const std::shared_ptr<Record>& record) {
+                return record->canceled || record->residentLevel == 0;
+            }), active.end());
+            std::this_thread::yield();
+        }
+    }
+
+    // context thread, before the context goes away: waits for worker copies and frees the buffers
+    void Shutdown()
+    {
+        ThreadPool::Shared().Wait();
+        for (Staging& s : staging)
+        {
+            if (s.buffer == 0)
+                continue;
+            if (s.state == STAGING_FILLING || s.state == STAGING_FILLED)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            if (s.fence)
+                glDeleteSync(s.fence);
+            glDeleteBuffers(1, &s.buffer);
+            s.buffer = 0;
+            s.fence = 0;
+            s.chunks.clear();
+            s.state = STAGING_FREE;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        active.clear();
+    }
+
+private:
+    struct Record {
+        unsigned int id = 0;
+        std::string path;
+        bool gamma = false;
+        TextureWrap wrap = TEXTURE_WRAP_REPEAT;
+        std::unique_ptr<CookedTexture> image;
+        std::atomic<bool> loaded{ false };
+        std::atomic<bool> canceled{ false };
+        bool failed = false;
+        bool allocated = false;
+        int residentLevel = -1;     // finest level with it and every coarser one uploaded
+        int nextLevel = -1;         // level whose rows are being handed out
+        int nextRow = 0;
+        int rowsDone[TEXTURE_COOK_MAX_LEVELS] = {};
+    };
+    struct Chunk {
+        std::shared_ptr<Record> record;
+        int level, y, rows;
+        size_t offset;
+    };
+    enum StagingState { STAGING_FREE, STAGING_FILLING, STAGING_FILLED, STAGING_IN_FLIGHT };
+    struct Staging {
+        GLuint buffer = 0;
+        unsigned char* mapped = nullptr;
+        GLsync fence = 0;
+        std::vector<Chunk> chunks;
+        std::atomic<int> state{ STAGING_FREE };
+    };
+
+    bool enabled = true;
+    std::vector<std::shared_ptr<Record>> active;
+    Staging staging[TEXTURE_STREAM_STAGING_COUNT];
+
+    void init()
+    {
+        for (Staging& s : staging)
+        {
+            glGenBuffers(1, &s.buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAM_STAGING_BYTES, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    bool idle() const
+    {
+        for (const Staging& s : staging)
+            if (s.state != STAGING_FREE)
+                return false;
+        return true;
+    }
+
+    // frees buffers whose uploads the GPU has consumed and advances the textures' base level
+    void retire(GLuint64 timeout)
+    {
+        for (Staging& s : staging)
+        {
+            if (s.state != STAGING_IN_FLIGHT)
+                continue;
+            GLenum status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(s.fence);
+            s.fence = 0;
+            for (Chunk& chunk : s.chunks)
+            {
+                chunk.record->rowsDone[chunk.level] += chunk.rows;
+                promote(*chunk.record);
+            }
+            s.chunks.clear();
+            s.state = STAGING_FREE;
+        }
+    }
+
+    // uploads from buffers the workers have finished copying into
+    void issue()
+    {
+        for (Staging& s : staging)
+        {
+            if (s.state != STAGING_FILLED)
+                continue;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            s.mapped = nullptr;
+            for (Chunk& chunk : s.chunks)
+            {
+                if (chunk.record->canceled)
+                    continue;
+                glBindTexture(GL_TEXTURE_2D, chunk.record->id);
+                uploadCookedRows(*chunk.record->image, chunk.level, chunk.y, chunk.rows, (const void*)chunk.offset);
+            }
+            s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            s.state = STAGING_IN_FLIGHT;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // gives loaded textures their storage and uploads the small tail of the mip chain directly
+    void allocateLoaded()
+    {
+        for (std::shared_ptr<Record>& record : active)
+        {
+            if (record->allocated || !record->loaded)
+                continue;
+            record->allocated = true;
+            CookedTexture& image = *record->image;
+            if (record->failed || !image.Valid())
+            {
+                std::cout << "Texture failed to load at path: " << record->path << std::endl;
+                record->residentLevel = 0;  // keeps the placeholder
+                continue;
+            }
+            glBindTexture(GL_TEXTURE_2D, record->id);
+            allocateCookedTexture(image, record->gamma);
+            GLint wrapMode = textureWrapMode(record->wrap, image.components);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+            int level = image.levels - 1;
+            while (level > 0 && cookedLevelBytes(image.width, image.height, image.components, level - 1) <= TEXTURE_STREAM_DIRECT_BYTES)
+                --level;
+            for (int l = image.levels - 1; l >= level; --l)
+            {
+                uploadCookedRows(image, l, 0, cookedLevelHeight(image.height, l), image.level[l]);
+                record->rowsDone[l] = cookedLevelHeight(image.height, l);
+            }
+            record->residentLevel = level;
+            record->nextLevel = level - 1;
+            record->nextRow = 0;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+            if (level == 0)
+                record->image.reset();
+        }
+    }
+
+    // hands out up to budget bytes of rows to free staging buffers, smallest levels first
+    void fill(size_t budget)
+    {
+        for (Staging& s : staging)
+        {
+            if (budget == 0)
+                break;
+            if (s.state != STAGING_FREE)
+                continue;
+            size_t capacity = std::min(budget, (size_t)TEXTURE_STREAM_STAGING_BYTES);
+            size_t used = 0;
+            for (std::shared_ptr<Record>& record : active)
+            {
+                if (!record->allocated || record->canceled)
+                    continue;
+                const CookedTexture* image = record->image.get();
+                while (record->nextLevel >= 0 && used < capacity)
+                {
+                    int level = record->nextLevel;
+                    size_t rowBytes = (size_t)cookedLevelWidth(image->width, level) * image->components;
+                    int height = cookedLevelHeight(image->height, level);
+                    int rows = (int)std::min<size_t>((capacity - used) / rowBytes, (size_t)(height - record->nextRow));
+                    if (rows == 0)
+                    {
+                        // always make progress, even when a single row is over the budget
+                        if (used > 0 || rowBytes > TEXTURE_STREAM_STAGING_BYTES)
+                            break;
+                        rows = 1;
+                    }
+                    Chunk chunk = { record, level, record->nextRow, rows, used };
+                    s.chunks.push_back(chunk);
+                    used += rowBytes * rows;
+                    record->nextRow += rows;
+                    if (record->nextRow == height)
+                    {
+                        record->nextLevel--;
+                        record->nextRow = 0;
+                    }
+                }
+                if (used >= capacity)
+                    break;
+            }
+            if (s.chunks.empty())
+                break;
+            budget -= std::min(budget, used);
+
+            // orphan the buffer so mapping doesn't wait for its previous upload
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+            s.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TEXTURE_STREAM_STAGING_BYTES,
+                                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            s.state = STAGING_FILLING;
+            Staging* target = &s;
+            ThreadPool::Shared().Submit([target]() {
+                TRACE_ZONE("stage texture rows");
+                for (const Chunk& chunk : target->chunks)
+                {
+                    const CookedTexture& image = *chunk.record->image;
+                    size_t rowBytes = (size_t)cookedLevelWidth(image.width, chunk.level) * image.components;
+                    if (target->mapped)
+                        std::memcpy(target->mapped + chunk.offset, image.level[chunk.level] + chunk.y * rowBytes, rowBytes * chunk.rows);
+                }
+                target->state = STAGING_FILLED;
+            });
+        }
+    }
+
+    // moves the base level down over every level that is now complete
+    void promote(Record& record)
+    {
+        if (record.canceled || !record.image)
+            return;
+        int level = record.residentLevel;
+        while (level > 0 && record.rowsDone[level - 1] == cookedLevelHeight(record.image->height, level - 1))
+            --level;
+        if (level == record.residentLevel)
+            return;
+        record.residentLevel = level;
+        glBindTexture(GL_TEXTURE_2D, record.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        if (level == 0)
+            record.image.reset();   // unmaps the cooked file
+    }
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU side loading work (mesh conversion, image decoding). Jobs
+// never touch GL; results are handed back to the context thread for upload.
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount)
+    {
+        threadCount = std::max(threadCount, 1u);
+        for (unsigned int i = 0; i < threadCount; ++i)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // pool shared by the loaders: one worker per hardware thread but the calling one
+    static ThreadPool& Shared()
+    {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+        return pool;
+    }
+
+    size_t Size() const { return workers.size(); }
+
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            ++pending;
+        }
+        wake.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+    // runs body(i) for i in [0, count) on the workers and the calling thread, returns when all are
+    // done. Helpers that only get scheduled after the work ran out return immediately, so this is
+    // safe to call from inside a job.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body)
+    {
+        if (count == 0)
+            return;
+        struct Work {
+            const std::function<void(size_t)>* body;
+            size_t count;
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> completed{ 0 };
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<Work> work = std::make_shared<Work>();
+        work->body = &body;
+        work->count = count;
+        auto drain = [](Work& w) {
+            size_t ran = 0;
+            for (size_t i = w.next++; i < w.count; i = w.next++, ++ran)
+                (*w.body)(i);
+            if (ran > 0 && (w.completed += ran) == w.count)
+            {
+                std::lock_guard<std::mutex> lock(w.mutex);
+                w.done.notify_all();
+            }
+        };
+        size_t helpers = std::min(count - 1, workers.size());
+        for (size_t h = 0; h < helpers; ++h)
+            Submit([work, drain]() { drain(*work); });
+        drain(*work);
+        std::unique_lock<std::mutex> lock(work->mutex);
+        work->done.wait(lock, [&] { return work->completed == count; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    size_t pending = 0;
+    bool stopping = false;
+
+    void run()
+    {
+        TRACE_THREAD_NAME("loader");
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+};
+
+#endif
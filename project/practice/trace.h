@@ -0,0 +1,317 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped instrumentation zones that are dumped as Chrome trace-event JSON (load the file in
+// chrome://tracing or ui.perfetto.dev). Every thread records into its own fixed size ring buffer,
+// so recording never takes a lock and never allocates after the first zone on a thread.
+//
+// Build with PRAC_TRACE=0 to compile every TRACE_* macro out. With tracing compiled in but
+// switched off at runtime a zone costs one relaxed atomic load.
+#ifndef PRAC_TRACE
+#define PRAC_TRACE 1
+#endif
+
+// number of events each thread keeps before the oldest ones are overwritten
+#define TRACE_RING_CAPACITY (1 << 15)
+// frames a GPU query pair may stay in flight before its slot is reused
+#define TRACE_GPU_LATENCY 4
+#define TRACE_GPU_ZONES_PER_FRAME 16
+
+struct TraceEvent {
+    const char* name;   // must be a string literal (or otherwise outlive the trace)
+    int64_t     begin;  // nanoseconds since Trace::Now() epoch
+    int64_t     end;
+};
+
+class TraceBuffer {
+public:
+    TraceEvent          events[TRACE_RING_CAPACITY];
+    std::atomic<uint64_t> head;
+    int                 tid;
+    std::string         threadName;
+
+    TraceBuffer(int tid) : head(0), tid(tid) {}
+
+    // single producer: only the owning thread ever writes
+    void Push(const char* name, int64_t begin, int64_t end)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        TraceEvent& e = events[h & (TRACE_RING_CAPACITY - 1)];
+        e.name = name;
+        e.begin = begin;
+        e.end = end;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+class Trace
+{
+public:
+    // runtime switch; zones opened while disabled record nothing
+    static void SetEnabled(bool enable)
+    {
+        enabledFlag().store(enable, std::memory_order_relaxed);
+    }
+    static bool Enabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    // monotonic clock shared by CPU zones and the correlated GPU timestamps
+    static int64_t Now()
+    {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // ring buffer of the calling thread, registered on first use
+    static TraceBuffer& ThreadBuffer()
+    {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (buffer == nullptr)
+            buffer = registerBuffer(nextTid().fetch_add(1));
+        return *buffer;
+    }
+
+    static void SetThreadName(const char* name)
+    {
+        TraceBuffer& buffer = ThreadBuffer();
+        std::lock_guard<std::mutex> lock(registryMutex());
+        buffer.threadName = name;
+    }
+
+    // the GPU track is a pseudo thread filled by GpuTimer::Collect() on the context thread
+    static TraceBuffer& GpuBuffer()
+    {
+        static TraceBuffer* buffer = registerBuffer(0, "GPU");
+        return *buffer;
+    }
+
+    // writes every buffered event as Chrome trace-event JSON. Safe to call while other threads
+    // keep recording: entries that may have been overwritten during the copy are skipped.
+    static bool Dump(const char* path)
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            std::printf("ERROR::TRACE::could not open %s\n", path);
+            return false;
+        }
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        bool first = true;
+        size_t written = 0;
+        std::vector<TraceEvent> copy;
+
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (TraceBuffer* buffer : registry())
+        {
+            uint64_t end = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin = end > TRACE_RING_CAPACITY ? end - TRACE_RING_CAPACITY : 0;
+            copy.clear();
+            for (uint64_t i = begin; i < end; ++i)
+                copy.push_back(buffer->events[i & (TRACE_RING_CAPACITY - 1)]);
+            // anything the producer lapped (or is writing right now) while we were copying is unreliable
+            uint64_t after = buffer->head.load(std::memory_order_acquire);
+            uint64_t firstValid = after + 1 > TRACE_RING_CAPACITY ? after + 1 - TRACE_RING_CAPACITY : 0;
+            size_t skip = firstValid > begin ? (size_t)(firstValid - begin) : 0;
+            if (skip > copy.size())
+                skip = copy.size();
+
+            fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->threadName.c_str());
+            first = false;
+            for (size_t i = skip; i < copy.size(); ++i)
+            {
+                const TraceEvent& e = copy[i];
+                fprintf(file, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    e.name, buffer->tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+                ++written;
+            }
+        }
+        fputs("\n]}\n", file);
+        fclose(file);
+        std::printf("Trace with %u events saved as %s\n", (unsigned int)written, path);
+        return true;
+    }
+
+    // dumps the trace when the process exits normally (including exit() from the capture loop)
+    static void DumpAtExit(const char* path)
+    {
+        exitPath() = path;
+        // construct the statics the handler touches first so they are destroyed after it runs
+        registryMutex();
+        registry();
+        std::atexit([]() { Trace::Dump(exitPath().c_str()); });
+    }
+
+private:
+    static std::atomic<bool>& enabledFlag()
+    {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+    static std::atomic<int>& nextTid()
+    {
+        static std::atomic<int> tid(1);
+        return tid;
+    }
+    static std::mutex& registryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+    static std::vector<TraceBuffer*>& registry()
+    {
+        static std::vector<TraceBuffer*> buffers;
+        return buffers;
+    }
+    static std::string& exitPath()
+    {
+        static std::string path;
+        return path;
+    }
+    // buffers are intentionally leaked so they stay valid for the atexit dump
+    static TraceBuffer* registerBuffer(int tid, const char* name = nullptr)
+    {
+        TraceBuffer* buffer = new TraceBuffer(tid);
+        buffer->threadName = name ? name : "thread " + std::to_string(tid);
+        std::lock_guard<std::mutex> lock(registryMutex());
+        registry().push_back(buffer);
+        return buffer;
+    }
+};
+
+// CPU zone: records [construction, destruction) into the calling thread's ring buffer
+class TraceZone {
+public:
+    TraceZone(const char* name) : name(name), begin(Trace::Enabled() ? Trace::Now() : -1) {}
+    ~TraceZone()
+    {
+        if (begin >= 0)
+            Trace::ThreadBuffer().Push(name, begin, Trace::Now());
+    }
+
+private:
+    const char* name;
+    int64_t begin;
+};
+
+// GPU zones use GL_TIMESTAMP queries (core since 3.3). Results are read back a few frames later
+// without stalling and shifted onto the CPU clock by an offset that is re-measured every second.
+class GpuTimer
+{
+public:
+    static GpuTimer& Get()
+    {
+        static GpuTimer timer;
+        return timer;
+    }
+
+    // returns the slot index to pass to End(), or -1 when the zone is not recorded
+    int Begin(const char* name)
+    {
+        if (!Trace::Enabled())
+            return -1;
+        if (queries[0] == 0)
+            init();
+        if (used >= TRACE_GPU_ZONES_PER_FRAME)
+            return -1;
+        int slot = frame * TRACE_GPU_ZONES_PER_FRAME + used++;
+        // the slot is still in flight from TRACE_GPU_LATENCY frames ago; resolve it (may block)
+        if (names[slot] != nullptr)
+            resolve(slot, true);
+        names[slot] = name;
+        glQueryCounter(queries[slot * 2], GL_TIMESTAMP);
+        return slot;
+    }
+    void End(int slot)
+    {
+        if (slot >= 0)
+            glQueryCounter(queries[slot * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // call once per frame on the context thread: publishes finished zones and advances the frame
+    void Collect()
+    {
+        if (queries[0] == 0)
+            return;
+        for (int slot = 0; slot < TRACE_GPU_LATENCY * TRACE_GPU_ZONES_PER_FRAME; ++slot)
+            if (names[slot] != nullptr)
+                resolve(slot, false);
+        frame = (frame + 1) % TRACE_GPU_LATENCY;
+        used = 0;
+        if (Trace::Now() - lastCalibration > 1000000000)
+            calibrate();
+    }
+
+private:
+    unsigned int queries[TRACE_GPU_LATENCY * TRACE_GPU_ZONES_PER_FRAME * 2] = {};
+    const char*  names[TRACE_GPU_LATENCY * TRACE_GPU_ZONES_PER_FRAME] = {};
+    int          frame = 0;
+    int          used = 0;
+    int64_t      gpuToCpu = 0;
+    int64_t      lastCalibration = 0;
+
+    void init()
+    {
+        glGenQueries(TRACE_GPU_LATENCY * TRACE_GPU_ZONES_PER_FRAME * 2, queries);
+        calibrate();
+    }
+    void calibrate()
+    {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        lastCalibration = Trace::Now();
+        gpuToCpu = lastCalibration - (int64_t)gpuNow;
+    }
+    void resolve(int slot, bool wait)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available && !wait)
+            return;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+        Trace::GpuBuffer().Push(names[slot], (int64_t)begin + gpuToCpu, (int64_t)end + gpuToCpu);
+        names[slot] = nullptr;
+    }
+};
+
+class GpuTraceZone {
+public:
+    GpuTraceZone(const char* name) : slot(GpuTimer::Get().Begin(name)) {}
+    ~GpuTraceZone() { GpuTimer::Get().End(slot); }
+
+private:
+    int slot;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if PRAC_TRACE
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+// records both the CPU submission and the GPU execution of the enclosed commands
+#define TRACE_GPU_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name); GpuTraceZone TRACE_CONCAT(gpuTraceZone, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Trace::SetThreadName(name)
+#define TRACE_GPU_COLLECT() GpuTimer::Get().Collect()
+#else
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_GPU_ZONE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_GPU_COLLECT() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Post-transform vertex cache helpers shared by the procedural primitives and imported meshes.
+// Indices are triangle lists.
+
+#define VERTEX_CACHE_SIZE 32        // simulated LRU size used while optimizing
+#define VERTEX_CACHE_FIFO_SIZE 16   // FIFO size used to report ACMR (a typical hardware cache)
+
+// average cache miss ratio: transformed vertices per triangle for a FIFO cache of cacheSize entries.
+// 3.0 is the worst case, ~0.5-0.7 is close to optimal for regular meshes.
+inline float computeACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_FIFO_SIZE)
+{
+    if (indexCount < 3)
+        return 0.0f;
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    unsigned int misses = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = indices[i];
+        // a vertex is still cached if fewer than cacheSize misses happened since it was loaded
+        if (time - timestamp[v] > cacheSize)
+        {
+            timestamp[v] = time++;
+            ++misses;
+        }
+    }
+    return (float)misses / (float)(indexCount / 3);
+}
+
+// reorders triangles in place for post-transform cache hits (Tom Forsyth's linear-speed
+// vertex cache optimisation). The vertex buffer is left untouched.
+inline void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // score tables
+    float cacheScore[VERTEX_CACHE_SIZE];
+    for (int i = 0; i < VERTEX_CACHE_SIZE; ++i)
+    {
+        if (i < 3)
+            cacheScore[i] = 0.75f;  // the last triangle's vertices: fixed score so it isn't reused immediately
+        else
+            cacheScore[i] = std::pow(1.0f - (float)(i - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    float valenceScore[64];
+    for (int i = 0; i < 64; ++i)
+        valenceScore[i] = i == 0 ? 0.0f : 2.0f * std::pow((float)i, -0.5f);
+
+    // vertex -> triangle adjacency
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; ++i)
+        liveTriangles[indices[i]]++;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(indexCount);
+    {
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; ++i)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    auto score = [&](unsigned int v) -> float {
+        unsigned int live = liveTriangles[v];
+        if (live == 0)
+            return -1.0f;
+        float s = valenceScore[live < 64 ? live : 63];
+        if (cachePosition[v] >= 0)
+            s += cacheScore[cachePosition[v]];
+        return s;
+    };
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = score((unsigned int)v);
+
+    std::vector<char> emitted(triangleCount, 0);
+
+    std::vector<unsigned int> result;
+    result.reserve(indexCount);
+    unsigned int cache[VERTEX_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    size_t scanStart = 0;
+    long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        if (best < 0)
+        {
+            // no candidate among cached vertices: fall back to the next unemitted triangle
+            while (emitted[scanStart])
+                ++scanStart;
+            best = (long)scanStart;
+        }
+        const unsigned int* tri = &indices[best * 3];
+        emitted[best] = 1;
+        result.push_back(tri[0]);
+        result.push_back(tri[1]);
+        result.push_back(tri[2]);
+
+        // push the triangle's vertices to the front of the LRU cache
+        unsigned int newCache[VERTEX_CACHE_SIZE + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            newCache[newCount++] = tri[k];
+            // remove the triangle from its vertices' live lists
+            unsigned int v = tri[k];
+            unsigned int* adj = &adjacency[offsets[v]];
+            unsigned int live = liveTriangles[v];
+            for (unsigned int a = 0; a < live; ++a)
+                if (adj[a] == (unsigned int)best)
+                {
+                    adj[a] = adj[live - 1];
+                    break;
+                }
+            liveTriangles[v]--;
+        }
+        for (int c = 0; c < cacheCount; ++c)
+        {
+            unsigned int v = cache[c];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+        for (int c = VERTEX_CACHE_SIZE; c < newCount; ++c)
+            cachePosition[newCache[c]] = -1;  // fell out of the cache
+        cacheCount = newCount < VERTEX_CACHE_SIZE ? newCount : VERTEX_CACHE_SIZE;
+        for (int c = 0; c < cacheCount; ++c)
+        {
+            cache[c] = newCache[c];
+            cachePosition[newCache[c]] = c;
+        }
+
+        // rescore the cached vertices and their triangles, picking the best next triangle
+        best = -1;
+        float bestScore = -1.0f;
+        for (int c = 0; c < newCount; ++c)
+        {
+            unsigned int v = newCache[c];
+            vertexScore[v] = score(v);
+        }
+        for (int c = 0; c < cacheCount; ++c)
+        {
+            unsigned int v = cache[c];
+            const unsigned int* adj = &adjacency[offsets[v]];
+            for (unsigned int a = 0; a < liveTriangles[v]; ++a)
+            {
+                unsigned int t = adj[a];
+                float s = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = (long)t;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < indexCount; ++i)
+        indices[i] = result[i];
+}
+
+#endif
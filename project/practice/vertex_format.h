@@ -0,0 +1,152 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Compact GPU vertex encodings shared by the geometry arena and imported meshes. Positions always
+// stay full precision in a stream of their own so depth-only passes fetch 12 bytes per vertex;
+// everything else goes into a second, optionally packed, attribute stream.
+
+enum VertexFormatFlags {
+    VERTEX_PACKED_NORMALS = 1 << 0,  // normal and tangent as GL_INT_2_10_10_10_REV, bitangent sign in w
+    VERTEX_HALF_TEXCOORDS = 1 << 1,  // texture coords as two GL_HALF_FLOATs
+    VERTEX_SKINNED        = 1 << 2,  // bone ids (16 bit) and weights (8 bit unorm) in a third stream
+    VERTEX_SHORT_INDICES  = 1 << 3   // GL_UNSIGNED_SHORT indices
+};
+#define VERTEX_FORMAT_COMPACT (VERTEX_PACKED_NORMALS | VERTEX_HALF_TEXCOORDS)
+
+// signed normalized 10:10:10:2, w rounded to -1, 0 or 1
+inline uint32_t packSnorm1010102(const glm::vec3& v, float w)
+{
+    auto component = [](float f) -> uint32_t {
+        int i = (int)std::lround(std::max(-1.0f, std::min(1.0f, f)) * 511.0f);
+        return (uint32_t)i & 0x3ffu;
+    };
+    int iw = w > 0.5f ? 1 : (w < -0.5f ? -1 : 0);
+    return component(v.x) | (component(v.y) << 10) | (component(v.z) << 20) | (((uint32_t)iw & 0x3u) << 30);
+}
+
+// IEEE binary16, round to nearest even
+inline uint16_t packHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t floatExponent = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (floatExponent == 0xffu)
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));   // inf / nan
+    int exponent = (int)floatExponent - 127 + 15;
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00u);                                // overflow to inf
+    if (exponent <= 0)
+    {
+        // subnormal half (or zero)
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half;     // a carry out of the mantissa correctly bumps the exponent
+    return (uint16_t)(sign | half);
+}
+
+// layout of one vertex in the attribute stream (everything but the position)
+struct VertexStreamLayout {
+    GLsizei stride = 0;
+    size_t normalOffset = 0;
+    size_t texCoordOffset = 0;
+    size_t tangentOffset = 0;
+    bool tangents = false;
+};
+
+inline VertexStreamLayout vertexStreamLayout(unsigned int format, bool tangents)
+{
+    VertexStreamLayout layout;
+    size_t direction = (format & VERTEX_PACKED_NORMALS) ? sizeof(uint32_t) : 4 * sizeof(float);
+    layout.normalOffset = 0;
+    layout.texCoordOffset = direction;
+    layout.tangentOffset = layout.texCoordOffset + ((format & VERTEX_HALF_TEXCOORDS) ? 2 * sizeof(uint16_t) : 2 * sizeof(float));
+    layout.tangents = tangents;
+    layout.stride = (GLsizei)(layout.tangentOffset + (tangents ? direction : 0));
+    return layout;
+}
+
+// encodes one vertex's attributes at dst; tangent.w carries the bitangent's handedness
+inline void writeVertexAttributes(unsigned char* dst, const VertexStreamLayout& layout, unsigned int format,
+                                  const glm::vec3& normal, const glm::vec2& texCoords, const glm::vec4& tangent = glm::vec4(0.0f))
+{
+    if (format & VERTEX_PACKED_NORMALS)
+    {
+        uint32_t n = packSnorm1010102(normal, 0.0f);
+        std::memcpy(dst + layout.normalOffset, &n, sizeof(n));
+        if (layout.tangents)
+        {
+            uint32_t t = packSnorm1010102(glm::vec3(tangent), tangent.w);
+            std::memcpy(dst + layout.tangentOffset, &t, sizeof(t));
+        }
+    }
+    else
+    {
+        float n[4] = { normal.x, normal.y, normal.z, 0.0f };
+        std::memcpy(dst + layout.normalOffset, n, sizeof(n));
+        if (layout.tangents)
+        {
+            float t[4] = { tangent.x, tangent.y, tangent.z, tangent.w };
+            std::memcpy(dst + layout.tangentOffset, t, sizeof(t));
+        }
+    }
+    if (format & VERTEX_HALF_TEXCOORDS)
+    {
+        uint16_t uv[2] = { packHalf(texCoords.x), packHalf(texCoords.y) };
+        std::memcpy(dst + layout.texCoordOffset, uv, sizeof(uv));
+    }
+    else
+    {
+        float uv[2] = { texCoords.x, texCoords.y };
+        std::memcpy(dst + layout.texCoordOffset, uv, sizeof(uv));
+    }
+}
+
+// points normal (1), texture coords (2) and, when present, tangent (3) of the bound vertex array
+// at the attribute stream bound to GL_ARRAY_BUFFER
+inline void setVertexAttributePointers(const VertexStreamLayout& layout, unsigned int format)
+{
+    bool packed = (format & VERTEX_PACKED_NORMALS) != 0;
+    glEnableVertexAttribArray(1);
+    if (packed)
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, layout.stride, (void*)layout.normalOffset);
+    else
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, layout.stride, (void*)layout.normalOffset);
+    glEnableVertexAttribArray(2);
+    if (format & VERTEX_HALF_TEXCOORDS)
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, layout.stride, (void*)layout.texCoordOffset);
+    else
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, layout.stride, (void*)layout.texCoordOffset);
+    if (layout.tangents)
+    {
+        glEnableVertexAttribArray(3);
+        if (packed)
+            glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, layout.stride, (void*)layout.tangentOffset);
+        else
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, layout.stride, (void*)layout.tangentOffset);
+    }
+}
+
+#endif